@@ -0,0 +1,46 @@
+/*
+ * ns per core of cpu_load over a 256 cpu snapshot, vector path against the plain loop.
+ * Build and run with: make bench
+ */
+#define main s4k_main
+#include "../s4k.c"
+#undef main
+
+#define CPUS   256
+#define ROUNDS 200000
+
+static unsigned long long snap[2][CpuFields * (CPUS + 1)];
+static unsigned int perc[2][CPUS + 1];
+
+static long long ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main() {
+	int i, r, n = CPUS + 1;
+	long long t;
+
+	srand(1);
+	for(i=0; i<CpuFields * n; i++) {
+		snap[0][i] = 1000000000ULL + rand() % 100000;
+		snap[1][i] = snap[0][i] + rand() % 200;
+	}
+
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		cpu_load_scalar(snap[1], snap[0], perc[0], 0, n);
+	printf("cpu_load scalar: %.2f ns per cpu\n", (double)(ns() - t) / ROUNDS / n);
+#ifdef USE_SIMD
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		cpu_load(snap[1], snap[0], perc[1], n);
+	printf("cpu_load simd:   %.2f ns per cpu\n", (double)(ns() - t) / ROUNDS / n);
+	if(memcmp(perc[0], perc[1], sizeof(perc[0])))
+		printf("cpu_load: simd and scalar results differ!\n");
+#endif
+
+	return 0;
+}
@@ -0,0 +1,363 @@
+/*
+ * Cost of a full status with the templates of FORMAT_METHOD, against the same layouts of
+ * sprinkles written out with the emitters the way the formatters were, and of building the
+ * status piece by piece with the strlen based aprintf macro the formatters used before
+ * against the t_status cursor, once as it is and once eight times as long. Then the
+ * number emitters against the snprintf calls they replaced, and the colour fades of
+ * sprinkles, computed per call by hexfade against the lookup in a t_gradient table.
+ * Build and run with: make bench
+ */
+#define main s4k_main
+#include "../s4k.c"
+#undef main
+
+#define ROUNDS 20000
+#define VALUES 1024
+
+// what aprintf expanded to before there was a t_status
+#define aprintf_strlen(STR, ...) snprintf(STR+strlen(STR), max_status_length-strlen(STR), __VA_ARGS__)
+
+typedef void (*format_f)(t_status *status);
+
+static const int funcs[] = { DATETIME, CPU, MEM, CLOCK, THERM, NET, SYSINFO };
+
+static t_gradient fade_full = { "f34", "3f4" };
+static t_gradient fade_hot  = { "3f4", "f34" };
+static t_gradient fade_tx   = { "645", "f45" };
+static t_gradient fade_rx   = { "564", "5f4" };
+
+static void fade_color(t_status *st, t_gradient *fade, int perc) {
+	aputs(st, "^[f");
+	aputn(st, gradient(fade, perc), 3);
+	aputs(st, ";");
+}
+
+static void escnum(t_status *st, const char *esc, long v) {
+	aputs(st, esc);
+	aputi(st, v);
+	aputs(st, ";");
+}
+
+// the templates of formats_dwm_sprinkles.h as code
+static void datetime_hand(t_status *st) {
+	astrftime(st, "^[f777;%d.%b %H:%M^[f;", localtime(&datetime_stat.time));
+}
+
+static void cpu_hand(t_status *st) {
+	unsigned int perc;
+	int i;
+
+	for(i=0; i<cpu_stat.num_groups; i++) {
+		perc = MIN(cpu_agg_value(&cpu_stat.load[i]), 100);
+		fade_color(st, &fade_hot, perc);
+		escnum(st, "^[v", MIN(perc / 10, 9));
+		aputs(st, "^[f;");
+	}
+	aputs(st, " ");
+}
+
+static void mem_hand(t_status *st) {
+	int perc = percent(mem_stat.info[MemAvailable], mem_stat.info[MemTotal]);
+
+	fade_color(st, &fade_full, perc);
+	escnum(st, "^[g31,", perc / 10);
+	aputs(st, "^[f;");
+	if(mem_stat.swapin.rate>=1) {
+		aputs(st, "^[ff34;");
+		aputu(st, mem_stat.swapin.rate, 0);
+		aputs(st, "^[f;");
+	}
+	aputs(st, delimiter);
+}
+
+static void clock_hand(t_status *st) {
+	int i;
+
+	for(i=0; i<cpu_stat.num_groups; i++)
+		escnum(st, "^[fea0;^[G15,", cpu_agg_value(&clock_stat.perc_agg[i]) / 10);
+	aputs(st, "^[f;");
+}
+
+static void therm_hand(t_status *st) {
+	int i, n = 0;
+	t_therm *therm;
+
+	for(i=0; i<therm_stat.num_therms; i++) {
+		therm = therm_stat.therms[i];
+		if(!therm->ok)
+			continue;
+		if(n++)
+			aputs(st, " ");
+		if(therm->temp<therm->warn) {
+			fade_color(st, &fade_hot, therm->temp<=40000 || therm->warn<=40000 ? 0 : (therm->temp - 40000) * 100LL / (therm->warn - 40000));
+			aputi(st, therm->temp / 1000);
+			aputs(st, "^[f999;°");
+		} else {
+			aputs(st, "^[bf00;^[i27;^[b; ^[ff00;");
+			aputi(st, therm->temp / 1000);
+			aputs(st, "^[f;°");
+		}
+	}
+	aputs(st, delimiter);
+}
+
+static void traf_hand(t_status *st, long traf, const char *sym, t_gradient *fade) {
+	if(traf>20) {
+		fade_color(st, fade, traf / 5120);
+		aputs(st, sym);
+		aputscaled(st, traf);
+	}
+	aputs(st, "^[f444;");
+	aputs(st, sym);
+}
+
+static void net_hand(t_status *st) {
+	static const int icons[] = { 28, 60, 39, 50, 57, 53 };
+	t_iface *iface;
+	int i;
+
+	for(i=0; i<net_stat.count; i++) {
+		iface = &net_stat.ifaces[i];
+		if(!iface->used || !strcmp(iface->name, "lo") || !iface->up || iface->idle>=10)
+			continue;
+		traf_hand(st, iface->txr.rate, "^[i38;", &fade_tx);
+		traf_hand(st, iface->rxr.rate, "^[i35;", &fade_rx);
+		escnum(st, "^[f555;^[i", icons[tv_net_type(i)]);
+		aputs(st, "^[f0;");
+	}
+	aputs(st, delimiter);
+}
+
+static void sysinfo_hand(t_status *st) {
+	int perc = percent(sysinfo_stat.ram_free, sysinfo_stat.ram_total);
+
+	fade_color(st, &fade_hot, sysinfo_stat.load[0] / (cpu_stat.num_cpus ? cpu_stat.num_cpus : 1));
+	aputu(st, sysinfo_stat.load[0] / 100, 0);
+	aputs(st, ".");
+	aputu(st, sysinfo_stat.load[0] % 100, 2);
+	aputs(st, "^[f; ");
+	fade_color(st, &fade_full, perc);
+	escnum(st, "^[g31,", perc / 10);
+	aputs(st, "^[f;");
+	aputs(st, delimiter);
+}
+
+static const format_f hand[] = {
+	datetime_hand, cpu_hand, mem_hand, clock_hand, therm_hand, net_hand, sysinfo_hand,
+};
+
+static long long ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static unsigned long long values[VALUES];
+
+// what the formatters printed scaled byte rates with
+static void scaled_snprintf(t_status *st, unsigned long long v) {
+	static const char units[] = "KMGTPE";
+	double d = v;
+	int u = -1;
+
+	if(v<1024) {
+		aprintf(st, "%llu", v);
+		return;
+	}
+	while(d>=1023.95 && u<5) {
+		d /= 1024;
+		u++;
+	}
+	aprintf(st, "%.1f%c", d, units[u]);
+}
+
+// how sprinkles faded colours before t_gradient, on every call
+static int hexfade_h2i(char c) {
+	if(c>'0' && c<='9') return 9 - ('9' - c);
+	if(c>='a' && c<='f') return 15 - ('f' - c);
+	return 0;
+}
+
+static void hexfade(const char *ca, const char *cb, double val, char r[4]) {
+	char a[4];
+	double s;
+	int amax = 0, bmax = 0, xmax = 0, i, x;
+
+	val = val < 0 ? 0 : (val > 1 ? 1 : val);
+	for(i = 0; i < 3; i++) {
+		x = hexfade_h2i(ca[i]);
+		if(x>amax) amax = x;
+		x = hexfade_h2i(cb[i]);
+		if(x>bmax) bmax = x;
+	}
+	for(i = 0; i < 3; i++) {
+		a[i] = hexfade_h2i(ca[i]) * val + hexfade_h2i(cb[i]) * (1 - val);
+		if(a[i]>xmax) xmax = a[i];
+	}
+	s = ((double)amax * val + (double)bmax * (1 - val)) / (double)xmax;
+	for(i = 0; i < 3; i++) {
+		x = a[i] * s;
+		r[i] = x>9 ? 'a' + x - 10 : '0' + x;
+	}
+	r[3] = 0;
+}
+
+// the status split before every escape and blank, roughly one piece per append
+static int pieces(const char *s, const char **start, int *len, int max) {
+	int n = 0;
+	const char *p;
+
+	for(p=s; *p && n<max; n++) {
+		start[n] = p;
+		for(p++; *p && *p!='^' && *p!=' '; p++);
+		len[n] = p - start[n];
+	}
+	return n;
+}
+
+int main() {
+	t_status *st, *tmp;
+	const char *start[512];
+	char old[4096], full[4096];
+	int len[512], num, i, r, k;
+	long long t;
+	t_gradient fade = { "f34", "3f4" };
+	char hv[4];
+	volatile unsigned int sink = 0; // keeps the colours from being optimized away
+
+	max_status_length = sizeof(old);
+	st = status_new(max_status_length);
+	tmp = status_new(max_status_length);
+
+	check_cpus();
+	check_clocks();
+	check_therms();
+	check_mem();
+	check_net();
+	// twice, so rates and loads have a previous sample
+	for(r=0; r<2; r++, usleep(100000)) {
+		get_datetime(tmp);
+		get_cpu(tmp);
+		get_mem(tmp);
+		get_clock(tmp);
+		get_therm(tmp);
+		get_net(tmp);
+		get_sysinfo(tmp);
+	}
+
+	// compiled on first use, not part of the timing
+	for(i=0; i<LENGTH(funcs); i++)
+		tpl_render(tmp, &templates[funcs[i]]);
+	t = ns();
+	for(r=0; r<ROUNDS; r++) {
+		status_reset(tmp);
+		for(i=0; i<LENGTH(hand); i++)
+			hand[i](tmp);
+	}
+	printf("emitters:            %.0f ns per status (%zu bytes)\n", (double)(ns() - t) / ROUNDS, tmp->len);
+	t = ns();
+	for(r=0; r<ROUNDS; r++) {
+		status_reset(st);
+		for(i=0; i<LENGTH(funcs); i++)
+			tpl_render(st, &templates[funcs[i]]);
+	}
+	printf("templates:           %.0f ns per status (%zu bytes)\n", (double)(ns() - t) / ROUNDS, st->len);
+	if(strcmp(st->buf, tmp->buf))
+		printf("  templates: the status differs from the sprinkles one!\n");
+
+	for(k=1; k<=8; k*=8) {
+		for(full[0]=0, i=0; i<k; i++)
+			strcat(full, st->buf);
+		num = pieces(full, start, len, LENGTH(start));
+		t = ns();
+		for(r=0; r<ROUNDS; r++) {
+			old[0] = 0;
+			for(i=0; i<num; i++)
+				aprintf_strlen(old, "%.*s", len[i], start[i]);
+		}
+		printf("%zu bytes, %d pieces\n", strlen(full), num);
+		printf("  strlen aprintf:    %.0f ns per status\n", (double)(ns() - t) / ROUNDS);
+		t = ns();
+		for(r=0; r<ROUNDS; r++) {
+			status_reset(tmp);
+			for(i=0; i<num; i++)
+				aprintf(tmp, "%.*s", len[i], start[i]);
+		}
+		printf("  t_status aprintf:  %.0f ns per status\n", (double)(ns() - t) / ROUNDS);
+		if(strcmp(old, tmp->buf) || strcmp(full, tmp->buf))
+			printf("  aprintf: the rebuilt status differs!\n");
+		t = ns();
+		for(r=0; r<ROUNDS; r++) {
+			status_reset(tmp);
+			for(i=0; i<num; i++)
+				aputn(tmp, start[i], len[i]);
+		}
+		printf("  t_status aputn:    %.0f ns per status\n", (double)(ns() - t) / ROUNDS);
+	}
+
+	// mostly small numbers, like the formatters print, and some byte rates
+	srand(1);
+	for(i=0; i<VALUES; i++)
+		values[i] = i % 4 ? rand() % 1000 : (unsigned long long)rand() << (rand() % 24);
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		for(status_reset(tmp), i=0; i<VALUES / 8; i++)
+			aprintf(tmp, "%llu", values[i]);
+	printf("snprintf %%llu:       %.1f ns per number\n", (double)(ns() - t) / ROUNDS / (VALUES / 8));
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		for(status_reset(tmp), i=0; i<VALUES / 8; i++)
+			aputu(tmp, values[i], 0);
+	printf("aputu:               %.1f ns per number\n", (double)(ns() - t) / ROUNDS / (VALUES / 8));
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		for(status_reset(tmp), i=0; i<VALUES / 8; i++)
+			aprintf(tmp, "%ld:%02ld", (long)values[i] / 60, (long)values[i] % 60);
+	printf("snprintf %%ld:%%02ld:  %.1f ns per number\n", (double)(ns() - t) / ROUNDS / (VALUES / 8));
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		for(status_reset(tmp), i=0; i<VALUES / 8; i++)
+			aputdur(tmp, values[i]);
+	printf("aputdur:             %.1f ns per number\n", (double)(ns() - t) / ROUNDS / (VALUES / 8));
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		for(status_reset(tmp), i=0; i<VALUES / 8; i++)
+			scaled_snprintf(tmp, values[i]);
+	printf("snprintf %%.1f%%c:     %.1f ns per number\n", (double)(ns() - t) / ROUNDS / (VALUES / 8));
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		for(status_reset(tmp), i=0; i<VALUES / 8; i++)
+			aputscaled(tmp, values[i]);
+	printf("aputscaled:          %.1f ns per number\n", (double)(ns() - t) / ROUNDS / (VALUES / 8));
+
+	// a colour per percentage, as fade_color does it for every value shown
+	t = ns();
+	gradient(&fade, 0);
+	printf("gradient table:      %.0f ns to build once\n", (double)(ns() - t));
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		for(i=0; i<=100; i++) {
+			hexfade("3f4", "f34", i / 100.0, hv);
+			sink += hv[0];
+		}
+	printf("hexfade:             %.1f ns per colour\n", (double)(ns() - t) / ROUNDS / 101);
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		for(i=0; i<=100; i++)
+			sink += gradient(&fade, i)[0];
+	printf("gradient:            %.1f ns per colour\n", (double)(ns() - t) / ROUNDS / 101);
+
+	// just below a unit both have to roll over to the next one
+	for(k=1; k<6; k++)
+		for(i=-64; i<64; i++) {
+			status_reset(st);
+			scaled_snprintf(st, (1ULL << (10 * k)) + i);
+			status_reset(tmp);
+			aputscaled(tmp, (1ULL << (10 * k)) + i);
+			if(strstr(tmp->buf, "1024") || strcmp(st->buf, tmp->buf))
+				printf("aputscaled: %llu gives %s, snprintf %s\n", (1ULL << (10 * k)) + i, tmp->buf, st->buf);
+		}
+
+	return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Cost of one /proc/meminfo read with keyed_read against the fscanf loop get_mem used
+ * before, and of the /proc/vmstat read that was added with it.
+ * Build and run with: make bench
+ */
+#define main s4k_main
+#include "../s4k.c"
+#undef main
+
+#define ROUNDS 20000
+
+static long long ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// get_mem as it was: fscanf until Cached
+static int fscanf_mem(unsigned int *vals) {
+	FILE *fp = fopen("/proc/meminfo", "r");
+	static char label[18];
+	unsigned int value;
+
+	if(fp==NULL)
+		return 0;
+	while(!feof(fp)) {
+		if(fscanf(fp, "%16[^:]: %u kB\n", label, &value)!=2)
+			break;
+		if(strncmp(label, "MemTotal", 8)==0)
+			vals[0] = value;
+		else if(strncmp(label, "MemFree", 7)==0)
+			vals[1] = value;
+		else if(strncmp(label, "Buffers", 7)==0)
+			vals[2] = value;
+		else if(strncmp(label, "Cached", 6)==0) {
+			vals[3] = value;
+			break;
+		}
+	}
+	fclose(fp);
+
+	return 1;
+}
+
+int main() {
+	unsigned int old[4];
+	int r;
+	long long t;
+
+	check_mem();
+
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		fscanf_mem(old);
+	printf("meminfo fscanf:     %.0f ns per read\n", (double)(ns() - t) / ROUNDS);
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		keyed_read(&mem_stat.meminfo, mem_stat.info);
+	printf("meminfo keyed_read: %.0f ns per read (%d keys)\n", (double)(ns() - t) / ROUNDS, NumMemKeys);
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		keyed_read(&mem_stat.vmstat, mem_stat.vm);
+	printf("vmstat keyed_read:  %.0f ns per read (%d keys)\n", (double)(ns() - t) / ROUNDS, NumVmKeys);
+
+	return 0;
+}
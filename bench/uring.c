@@ -0,0 +1,60 @@
+/*
+ * One tick of reading the usual /proc and /sys files: pread one by one against a single
+ * io_uring batch (uring_prefetch, then src_read picks the results up).
+ * Build and run with: make bench, io_uring is used even without USE_URING in config.mk
+ */
+#ifndef USE_URING
+#define USE_URING
+#endif
+#define main s4k_main
+#include "../s4k.c"
+#undef main
+
+#define ROUNDS 5000
+#define FILES  32
+
+static t_source files[FILES];
+
+static long long ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main() {
+	static const char *fixed[] = { "/proc/stat", "/proc/meminfo", "/proc/vmstat", "/proc/net/dev", "/proc/loadavg" };
+	char due[NUMFUNCS] = { 1 }, path[BUF_SIZE];
+	int i, r, n = 0;
+	long long t;
+
+	for(i=0; i<LENGTH(fixed); i++)
+		src_open(&files[n++], 0, BUF_SIZE * 8, "%s", fixed[i]);
+	for(i=0; n<FILES && i<FILES; i++) { // small sysfs files, like therms and clocks read
+		snprintf(path, BUF_SIZE, "/sys/class/thermal/thermal_zone%d/temp", i);
+		if(access(path, R_OK)==0)
+			src_open(&files[n++], 0, BUF_SIZE, "%s", path);
+		snprintf(path, BUF_SIZE, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", i);
+		if(n<FILES && access(path, R_OK)==0)
+			src_open(&files[n++], 0, BUF_SIZE, "%s", path);
+	}
+	if(!uring_init()) {
+		printf("uring: io_uring_setup failed, nothing to compare\n");
+		return 0;
+	}
+
+	t = ns();
+	for(r=0; r<ROUNDS; r++)
+		for(i=0; i<n; i++)
+			src_read(&files[i]);
+	printf("pread: %.0f ns per tick of %d files\n", (double)(ns() - t) / ROUNDS, n);
+	t = ns();
+	for(r=0; r<ROUNDS; r++) {
+		uring_prefetch(due);
+		for(i=0; i<n; i++)
+			src_read(&files[i]);
+	}
+	printf("uring: %.0f ns per tick of %d files\n", (double)(ns() - t) / ROUNDS, n);
+
+	return 0;
+}
@@ -3,12 +3,25 @@ static int max_big_messages    = 0;         // max num of messages (long texts)
 static int refresh_wait        = 1;         // time between refresh in seconds
 static int max_status_length   = 512;       // max length of status
 static int auto_delimiter      = 0;         // automagically add delimiter on success
+static int rate_smoothing      = 0;         // EWMA time constant of net and vmstat (swap, fault) rates in seconds (0: off)
+static int battery_smoothing   = 10;        // EWMA time constant of the battery rate in seconds
+static int cpu_grouping        = GroupThread; // cpus are shown per GroupThread, GroupCore, GroupDie, GroupPackage, GroupNode or GroupAll
+static int cpu_aggregate       = AggAvg;    // value of a cpu group: AggMin, AggAvg, AggMax or AggHot (percent of cpus at cpu_hot_load)
+static int cpu_hot_load        = 80;        // load in percent from which a cpu counts as hot
+static int therm_warning       = 75;        // warning temperature of channels without trip points
+#ifdef USE_THREADS
+static int sensor_budget       = 100;       // time in ms a sensor may take per read
+static int budget_strikes      = 3;         // reads in a row over the budget until it gets a thread
+static char stale_mark[]       = "~";       // shown before the last reading of an overdue thread
+#endif
 static char delimiter[]        = "^[f37C;|^[f;";    // delimiter ^[d;
 static char *brightnes_names[] = { "acpi_video0" };
+// thermal zone types (x86_pkg_temp, acpitz) and hwmon "chip:label" channels (coretemp:Package id 0,
+// k10temp:Tctl, nvme:*) to watch, a trailing * matches any rest, "*" alone all thermal zones
+static char *therm_types[]     = { "*" };
 #ifdef USE_NOTIFY
 static int marquee_chars       = 30;        // TODO: description!
 static int marquee_offset      = 3;         // TODO: description!
-static int message_length      = 10;        // TODO: description!
 #endif
 #ifdef USE_SOCKETS
 static char mp_adress[]        = "127.0.0.1";
@@ -16,18 +29,55 @@ static char mp_adress[]        = "127.0.0.1";
 //static char (*mp_parse)()      = mp_parse_mpd;
 static int mp_port             = 6666;
 static char (*mp_parse)()      = mp_parse_madasul;
+static int con_timeout         = 3000;      // ms a connect or a reply may take
+static int con_backoff_min     = 500;       // ms until connecting again after a failure,
+static int con_backoff_max     = 60000;     // doubled for every failure in a row
 #endif
 #ifdef USE_ALSAVOL
 static const char ATTACH[]     = "default"; // device
 static const char SELEM_NAME[] = "Master";  // mixer
 #endif
 
+// refresh interval of every sensor in seconds (0: refresh_wait), battery and brightness
+// are also refreshed on kernel uevents, so they only need a slow safety interval
+static int sensor_intervals[NUMFUNCS] = {
+	[DATETIME] = 60, [CPU] = 1, [MEM] = 2, [CLOCK] = 1, [THERM] = 5, [NET] = 2, [WIFI] = 5, [BATTERY] = 60, [BRIGHTNESS] = 30,
+	[SYSINFO] = 2,
+#ifdef USE_SOCKETS
+	[MP] = 1,
+#endif
+#ifdef USE_ALSAVOL
+	[AVOL] = 2,
+#endif
+#ifdef USE_NOTIFY
+	[NOTIFY] = 1,
+#endif
+};
+
+#ifdef USE_THREADS
+// time in ms a read may take (0: sensor_budget). A sensor that takes longer budget_strikes
+// times in a row is moved to a thread (not the ones sensor_threads refuses), one whose
+// thread is overdue shows stale_mark
+static int sensor_budgets[NUMFUNCS] = { [THERM] = 250, }; // some hwmon drivers wake the device up
+// sensors that are read on their own thread, they may block without holding up the
+// others, their segment keeps the last reading meanwhile. BATTERY, BRIGHTNESS and NOTIFY
+// are refreshed by the main thread and refused here.
+static char sensor_threads[NUMFUNCS] = {
+#ifdef USE_SOCKETS
+	[MP] = 1,
+#endif
+#ifdef USE_ALSAVOL
+	[AVOL] = 1,
+#endif
+};
+#endif
+
 static int status_funcs_order[] = {
     NET,
 #ifdef USE_SOCKETS
 	MP,
 #endif
-	/*CLOCK,*/ CPU, THERM, MEM, WIFI, BATTERY, BRIGHTNESS,
+	/*CLOCK,*/ CPU, THERM, MEM, /*SYSINFO,*/ WIFI, BATTERY, BRIGHTNESS,
 #ifdef USE_ALSAVOL
 	AVOL,
 #endif
@@ -39,4 +89,20 @@ static int message_funcs_order[] = { NOTIFY, };
 #define NO_MSG_FUNCS
 #endif
 
+// further renderings of the same readings, nothing is read twice for them. Every view
+// replaces its sink file when it changed, its layouts are templates (see tpl_compile)
+// and are spliced in the order of the sensors.
+/*
+static t_template html_view[NUMFUNCS] = {
+	[DATETIME] = { "<span class=\"date\">{time:%d %b %Y %H:%M}</span>" },
+	[CPU]      = { "<span class=\"cpu\">{#cpu: }{cpu.load}%{/}</span>" },
+	[MEM]      = { "<span class=\"mem\">{mem.free}% free</span>" },
+	[THERM]    = { "<span class=\"therm\">{#therm: }{?therm.ok}{therm.temp}&deg;{/}{/}</span>" },
+	[NET]      = { "<span class=\"net\">{#net:, }{?net.shown}{net.name} {net.rx:/1024}K/{net.tx:/1024}K{/}{/}</span>" },
+	[BATTERY]  = { "<span class=\"bat\">{?bat.ac}AC{/}{!bat.ac}{#bat: }{bat.perc}%{/} {bat.minutes:/60}:{bat.minutes:%60 02}{/}</span>" },
+};
+static t_view views[] = { { "/tmp/s4k.html", html_view }, };
+*/
+#define NO_VIEWS
+
 #include FORMAT_METHOD
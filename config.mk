@@ -29,10 +29,22 @@ NOTIFY_CFILES = notify.c
 ALSAVOL_LIBS = -lasound
 ALSAVOL_FLAGS = -DUSE_ALSAVOL
 
+# slow sensors (player, mixer) are read on their own threads, see sensor_threads in config.h
+THREAD_LIBS = -lpthread
+THREAD_FLAGS = -DUSE_THREADS
+
+# cpu load of four cpus at a time with gcc/clang vector types (gcc >= 9), the plain
+# loop is used without it
+SIMD_FLAGS = -DUSE_SIMD
+
+# io_uring reads all files of a tick in one batch (linux >= 5.6, falls back to pread).
+# procfs reads are handed to kernel workers, compare with make bench before using it
+#URING_FLAGS = -DUSE_URING
+
 INCS = -I. -I/usr/include ${X11_INCS} ${NOTIFY_INCS}
-LIBS = -L/usr/lib -lc ${X11_LIBS} ${NOTIFY_LIBS} ${ALSAVOL_LIBS}
+LIBS = -L/usr/lib -lc ${X11_LIBS} ${NOTIFY_LIBS} ${ALSAVOL_LIBS} ${THREAD_LIBS}
 
-CPPFLAGS = -D_DEFAULT_SOURCE -DVERSION=\"${VERSION}\" ${X11_FLAGS} ${SOCKET_FLAGS} ${NOTIFY_FLAGS} ${ALSAVOL_FLAGS} ${FORMATER}
+CPPFLAGS = -D_DEFAULT_SOURCE -DVERSION=\"${VERSION}\" ${X11_FLAGS} ${SOCKET_FLAGS} ${NOTIFY_FLAGS} ${ALSAVOL_FLAGS} ${THREAD_FLAGS} ${SIMD_FLAGS} ${URING_FLAGS} ${FORMATER}
 #CFLAGS = -std=c99 -ggdb -pedantic -Wall -Wno-unused-function -O0 ${INCS} ${CPPFLAGS}
 CFLAGS = -std=c99 -pedantic -Wall -Wno-unused-function -O2 ${INCS} ${CPPFLAGS}
 LDFLAGS = ${LIBS}
@@ -10,7 +10,6 @@ static char delimiter[]        = "^[d;";    // delimiter
 #ifdef USE_NOTIFY
 static int marquee_chars       = 30;        // 
 static int marquee_offset      = 3;         // 
-static int message_length      = 10;        // 
 #endif
 #ifdef USE_SOCKETS
 static char cmus_adress[]      = "/home/USER/.cmus/socket"; // socket adressfor cmus
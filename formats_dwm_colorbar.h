@@ -1,167 +1,35 @@
-/* +++ FORMAT FUNCTIONS +++ */
-static inline void datetime_format(char *status) {
-	strftime(status + strlen(status), max_status_length - strlen(status), "%d %b %Y - %I:%M", localtime(&datetime_stat.time));
-}
-
-static inline void cpu_format(char *status) {
-	static unsigned int o_running=0, o_total=0;
-	unsigned int running = cpu_stat.user + cpu_stat.nice + cpu_stat.system, total = running + cpu_stat.idle;
-	unsigned int perc = ((running - o_running) * 100) / (total - o_total);
-
-	if(perc>100) perc=100;
-
-	if(perc>85)
-		aprintf(status, "L \x06%d\x01%%", perc);
-	else
-		aprintf(status, "L \x08%d\x01%%", perc);
-
-	o_running = running;
-	o_total = total;
-}
-
-static inline void mem_format(char *status) {
-	int free = mem_stat.free + mem_stat.buffers + mem_stat.cached;
-	int perc = mem_stat.total ? (free * 100) / mem_stat.total : 0;
-
-	if(perc<15)
-		aprintf(status, "M \x06%d\x01%%", perc);
-	else
-		aprintf(status, "M \x08%d\x01%%", perc);
-}
-
-static inline void clock_format(char *status) {
-	int i, clk;
-	char *s, m[]="mHz", g[]="gHz";
-
-	for(i=0; i<clock_stat.num_clocks; i++) {
-		if(clock_stat.clocks[i]>1000000) {
-			clk = clock_stat.clocks[i] / 1000000;
-			s = g;
-		} else {
-			clk = clock_stat.clocks[i] / 1000;
-			s = m;
-		}
-		if(i<clock_stat.num_clocks-1)
-			aprintf(status, "%d%s, ", clk, s);
-		else
-			aprintf(status, "%d%s", clk, s);
-	}
-}
-
-static inline void therm_format(char *status) {
-	int i, t;
-	// TODO: get WARNING temp from sys!
-
-	for(i=0; i<therm_stat.num_therms; i++) {
-		t = therm_stat.therms[i] / 1000;
-		if(t>75)
-			aprintf(status, "\x02%d\x01°", t);
-		else
-			aprintf(status, "%d°", t);
-		if(i<therm_stat.num_therms-1)
-			aprintf(status, ", ");
-	}
-	aprintf(status, "%s", delimiter);
-}
-
-static inline void net_format(char *status) {
-	int i;
-	if(net_stat.count>0) {
-		for(i=0; i<net_stat.count; i++)
-			if(strncmp(net_stat.devnames[i], "lo", 2)) {
-				if(i<net_stat.count-1)
-					aprintf(status, "\x08%s\x01 UP, ", net_stat.devnames[i]);
-				else
-					aprintf(status, "\x08%s\x01 UP", net_stat.devnames[i]);
-			}
-	} else
-		aprintf(status, "\x07net\x01 DOWN");
-}
-
-static inline void wifi_format(char *status) {
-	if(wifi_stat.perc<20)
-		aprintf(status, "%s \x06%d\x01%%", wifi_stat.devname, wifi_stat.perc);
-	else
-		aprintf(status, "%s \x08%d\x01%%", wifi_stat.devname, wifi_stat.perc);
-}
-
-static inline void battery_format(char *status) {
-	int i;
-	int totalremaining = 0;
-
-	int cstate = 1;
-	for(i=0; i<num_batteries; i++)
-		if(battery_stats[i].state!=BatCharged) cstate = 0;
-	if(cstate) {
-		aprintf(status, "=|");
-	} else {
-		aprintf(status, "||");
-		for(i=0; i<num_batteries; i++) {
-			if(battery_stats[i].state==BatCharging) {
-				aprintf(status, " >%d%%", (100 * battery_stats[i].remaining) / battery_stats[i].capacity);
-				totalremaining += (battery_stats[i].remaining * 60) / battery_stats[i].rate;
-			} else if(battery_stats[i].state==BatDischarging) {
-				aprintf(status, " <%d%%", (100 * battery_stats[i].remaining) / battery_stats[i].capacity);
-				totalremaining += (battery_stats[i].remaining * 60) / battery_stats[i].rate;
-			}
-		}
-		if(totalremaining)
-			aprintf(status, " %c[%d:%02d]", totalremaining<1800 ? (totalremaining<300 ? 6 : 7) : 8, totalremaining / 60, totalremaining%60);
-	}
-}
-
+/*
+ * Layouts for dwm with the colorbar patch, bytes \x01 to \x08 switch colours: \x01 resets,
+ * \x06, \x07 and \x08 go from bad to good, \x02 marks a hot sensor. See tpl_compile() in
+ * s4k.c for the syntax and tpl_vars[] for the values that can be shown.
+ */
+static t_template templates[NUMFUNCS] = {
+	[DATETIME]   = { "{time:%d %b %Y - %I:%M}" },
+	[CPU]        = { "L {?cpu.total>85}\x06{/}{!cpu.total>85}\x08{/}{cpu.total}\x01%" },
+	[MEM]        = { "M {?mem.free<15}\x06{/}{!mem.free<15}\x08{/}{mem.free}\x01%{?mem.swapin} S \x06{mem.swapin}\x01/s{/}" },
+	[CLOCK]      = { "{#clock:, }{?clock.mhz>1000}{clock.mhz:/1000}gHz{/}{!clock.mhz>1000}{clock.mhz}mHz{/}{/}" },
+	[THERM]      = { "{#therm:, }{?therm.ok}{?therm.warn}\x02{therm.temp}\x01°{/}{!therm.warn}{therm.temp}°{/}{/}{/}{delim}" },
+	[NET]        = { "{#net:, }{?net.shown}{?net.up}\x08{net.name}\x01 UP{/}{!net.up}\x07{net.name}\x01 DOWN{/}{/}{/}"
+	                 "{!net.num}\x07net\x01 DOWN{/}" },
+	[WIFI]       = { "{wifi.name} {?wifi.perc<20}\x06{/}{!wifi.perc<20}\x08{/}{wifi.perc}\x01%" },
+	[BATTERY]    = { "{?bat.ac}=|{/}{!bat.ac}||{#bat}{?bat.charging} >{bat.perc}%{/}{?bat.discharging} <{bat.perc}%{/}{/}"
+	                 "{?bat.minutes} {?bat.minutes<300}\x06{/}{?bat.minutes>299}{?bat.minutes<1800}\x07{/}{/}{?bat.minutes>1799}\x08{/}"
+	                 "[{bat.minutes:/60}:{bat.minutes:%60 02}]{/}{/}" },
+	[BRIGHTNESS] = { "{#brightness:, }B \x08{brightness.perc}\x01%{/}" },
+	[SYSINFO]    = { "L {?sys.cpuload>99}\x06{/}{!sys.cpuload>99}\x08{/}{sys.load:/100}.{sys.load:%100 02}"
+	                 "\x01 M {?sys.free<15}\x06{/}{!sys.free<15}\x08{/}{sys.free}\x01% up "
+	                 "{sys.uptime:/1440}d {sys.uptime:/60 %24}:{sys.uptime:%60 02}" },
 #ifdef USE_SOCKETS
-static inline void cmus_format(char *status) {
+	[MP]         = { "{?mp.status>0}{mp.artist} - {mp.title}{?mp.playing} {mp.position}/{mp.duration}s {?mp.repeat}[rpt]{/}{?mp.shuffle}^[shfl]{/}"
 #ifndef USE_ALSAVOL
-	int v;
+	                 " {mp.volume}%"
 #endif
-	if(mp_stat->status>0) {
-		aprintf(status, "%s - %s", mp_stat->artist, mp_stat->title);
-		if(mp_stat->status==1) {
-			aprintf(status, " %d/%ds %s%s", mp_stat->position, mp_stat->duration, mp_stat->repeat ? "[rpt]" : "", mp_stat->shuffle ? "^[shfl]" : "");
-#ifndef USE_ALSAVOL
-			v = mp_stat->volume * 100 / 100;
-			aprintf(status, " %d%%", v);
-#endif
-		}
-		aprintf(status, "^[f0;%s", delimiter);
-	}
-}
+	                 "{/}^[f0;{delim}{/}" },
 #endif
-
 #ifdef USE_ALSAVOL
-static inline void alsavol_format(char *status) {
-	int tvol = alsavol_stat.vol_max - alsavol_stat.vol_min;
-	int perc = tvol ? ((alsavol_stat.vol - alsavol_stat.vol_min) * 100) / tvol : 0;
-
-	aprintf(status, "V %d%%", perc);
-}
+	[AVOL]       = { "V {vol.perc}%" },
 #endif
-
 #ifdef USE_NOTIFY
-static inline void notify_format(char *status) {
-	char fmt[message_length];
-	int offset;
-	int remaining = (notify_stat.message->started_at + notify_stat.message->expires_after) - time(NULL);
-
-	if(remaining>0)
-		aprintf(status, "%d ", remaining);
-
-	aprintf(status, "%s: %s", notify_stat.message->appname, notify_stat.message->summary);
-
-	if(notify_stat.message->body[0]!=0) {
-		if(strlen(notify_stat.message->body) < marquee_chars) {
-			aprintf(status, " [%s]", notify_stat.message->body);
-		} else {
-			offset = (time(NULL) - notify_stat.message->started_at) - 1;
-			offset *= marquee_offset;
-			if(offset > strlen(notify_stat.message->body) - marquee_chars)
-				offset = strlen(notify_stat.message->body) - marquee_chars;
-			if(offset<0)
-				offset = 0;
-			snprintf(fmt, message_length, " [%%.%ds]", marquee_chars);
-			aprintf(status, fmt, notify_stat.message->body + offset);
-		}
-	}
-}
+	[NOTIFY]     = { "{?notify.remaining}{notify.remaining} {/}{notify.app}: {notify.summary}{?notify.body} [{notify.body}]{/}" },
 #endif
+};
@@ -95,6 +95,15 @@ char notify_check() {
 	}
 	return 0;
 }
+
+// file descriptor of the dbus connection to wait on (-1 if there is none)
+int notify_fd() {
+	int fd = -1;
+
+	if( dbus_conn==NULL || !dbus_connection_get_unix_fd(dbus_conn, &fd) )
+		return -1;
+	return fd;
+}
  
 // to support libnotify events, we must implement:
 //
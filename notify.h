@@ -28,3 +28,6 @@ notification *notify_get_message(int *n);
 
 // check the dbus for notifications (1=something happened, 0=nothing)
 char notify_check();
+
+// file descriptor of the dbus connection to wait on (-1 if there is none)
+int notify_fd();
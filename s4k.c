@@ -10,15 +10,15 @@
  *   memory usage (/proc)
  *   cpu clock (/sys)
  *   cpu temperature (acpi, /sys)
- *   network stat (/proc) TODO: find a way to get reliable up/down status
+ *   network stat and link state (rtnetlink, /proc as fallback)
  *   wifi signal strength (/proc)
  *   battery stats (/proc)
+ *   uptime, load and coarse memory (sysinfo)
  *   cmus, mpd stats (socket [unix, inet])
  *   volume setting (alsa lib) // TODO: find a better way
  *   notify (dbus, notify.c)
  *
  * Planned:
- *   uptime (/proc)
  *   imap mail (inet socket [ssl lib])
  *   local mail (filesystem)
  *   fan (/proc [at least for ibm])
@@ -31,14 +31,18 @@
  *
  * Every Sensor has:
  *  a function that gets data, named get_NAME, returning 1 on success and 0 on failure
- *  a format function, named NAME_format
+ *  a template in the templates[] of every formats_*.h, rendered with tpl_render
  *  a struct variable for its data, named NAME_stat
+ *  an interval in sensor_intervals (config.h), main only calls get_NAME when it is due
  *
- * If a sensor needs some initialisation, it should be made in main. A formater has to
- * be made at least for dwm, and copyed in every other formater.
+ * If a sensor needs some initialisation, it should be made in main. Values a template can
+ * show are in tpl_vars, a new sensor adds its own there.
  */
-#define _POSIX_C_SOURCE 1 // needed for fdopen
+#define _POSIX_C_SOURCE 200809L // needed for getaddrinfo, clock_nanosleep
 
+#include <errno.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -51,10 +55,20 @@
 #endif
 
 #include <dirent.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/sysinfo.h>
+#include <sys/timerfd.h>
 
 #ifdef USE_SOCKETS
 #include <sys/un.h>
-#include <fcntl.h>
 #include <netdb.h>
 #endif
 
@@ -62,6 +76,17 @@
 #include "alsa/asoundlib.h"
 #endif
 
+#ifdef USE_THREADS
+#include <pthread.h>
+#include <sys/eventfd.h>
+#endif
+
+#ifdef USE_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
 #ifdef USE_NOTIFY
 #include <dbus/dbus.h>
 #include "notify.h"
@@ -69,7 +94,6 @@
 
 
 /* macros */
-#define aprintf(STR, ...)            snprintf(STR+strlen(STR), max_status_length-strlen(STR), __VA_ARGS__)
 #define LENGTH(X)                    (sizeof X / sizeof X[0])
 #define MAX(A, B)                    ((A) > (B) ? (A) : (B))
 #define MIN(A, B)                    ((A) < (B) ? (A) : (B))
@@ -78,13 +102,39 @@
 
 /* statics */
 #define BUF_SIZE            256
+#define URING_ENTRIES       64
+#define FP_INIT             0xcbf29ce484222325ULL // start of a fingerprint
+#define CON_RING            4096                  // bytes received but not parsed yet, a power of 2
+#define NL_RETRIES          8                     // failed rtnetlink dumps in a row before /proc/net/dev for good
 
 
 /* enmus */
 enum { BatCharged, BatCharging, BatDischarging, BatUnknown };
 
+enum { EvTimer, EvSignal, EvNotify, EvMp, EvUevent, EvRtnl, EvCollect }; // what woke up the reactor
+
+enum { BatKeyStatus, BatKeyPresent, BatKeyPowerNow, BatKeyCurrentNow, BatKeyEnergyNow, BatKeyChargeNow,
+	BatKeyEnergyFull, BatKeyChargeFull, NumBatKeys }; // POWER_SUPPLY_* keys of a battery uevent file
+
+enum { UevAction, UevSubsystem, NumUevKeys }; // keys of a kernel uevent message
+
+enum { MemTotal, MemFree, MemAvailable, MemBuffers, MemCached, MemSwapTotal, MemSwapFree,
+	NumMemKeys }; // keys of /proc/meminfo
+
+enum { VmPswpin, VmPswpout, VmPgfault, VmPgmajfault, NumVmKeys }; // keys of /proc/vmstat
+
+enum { GroupThread, GroupCore, GroupDie, GroupPackage, GroupNode, GroupAll }; // how cpus are grouped
+
+enum { AggMin, AggAvg, AggMax, AggHot }; // what is shown of a cpu group
+
+enum { ConClosed, ConConnecting, ConReady }; // state of a connection
+
+enum { MpdPlayer = 1, MpdMixer = 2, MpdOptions = 4, MpdAll = 7 }; // mpd subsystems watched with idle
+
+enum { TplLit, TplNum, TplStr, TplTime, TplIf, TplIfNot, TplLoop, TplEnd }; // steps of a compiled template
+
 enum {
-	DATETIME, CPU, MEM, CLOCK, THERM, NET, WIFI, BATTERY, BRIGHTNESS,
+	DATETIME, CPU, MEM, CLOCK, THERM, NET, WIFI, BATTERY, BRIGHTNESS, SYSINFO,
 #ifdef USE_SOCKETS
 	MP,
 #endif
@@ -98,6 +148,47 @@ enum {
 
 
 /* structs */
+typedef struct { // per second rate of a counter, or a smoothed gauge
+	unsigned long long last;
+	long long ts;       // CLOCK_MONOTONIC in ms of the last sample
+	int samples;
+	double rate;
+} t_rate;
+
+typedef struct { // text formatters append to, appending never rescans what is there
+	char *buf;
+	size_t len;
+	size_t size;
+	char truncated;     // something did not fit and was left out
+	unsigned long long fp; // fingerprint of the inputs buf was formatted from
+	char valid;         // fp belongs to buf
+	char dirty;         // formatted again since the status was last spliced
+} t_status;
+
+typedef struct { // file that is opened once and re-read with pread
+	char *path;
+	int fd;
+	char *buf;
+	size_t size;
+	size_t len;         // of the last read
+	int owner;          // sensor reading it
+#ifdef USE_URING
+	char prefetched;    // buf was filled by uring_prefetch
+	int res;
+#endif
+} t_source;
+
+#ifdef USE_URING
+typedef struct { // submission and completion rings
+	int fd;
+	unsigned int entries;
+	unsigned int *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+} t_uring;
+#endif
+
 #ifdef USE_ALSAVOL
 typedef struct { // volume
 	long vol;
@@ -106,13 +197,20 @@ typedef struct { // volume
 } t_alsavol;
 #endif
 
+typedef struct { // value of a KEY=VALUE line
+	const char *str;    // NULL if the key was missing
+	long long num;      // signed, some drivers report negative currents
+} t_kv;
+
 typedef struct { // battery
 	int num_bats;
 	int *state;
-	unsigned int *rate;
-	unsigned int *remaining;
-	unsigned int *capacity;
+	long long *rate;
+	long long *remaining;
+	long long *capacity;
 	char **name;
+	t_source *src;
+	t_rate total_rate;  // smoothed sum of all rates
 } t_bateries;
 
 typedef struct { // brightness
@@ -120,46 +218,104 @@ typedef struct { // brightness
 	unsigned int *brghts;
 	unsigned int *max_brghts;
 	char **devnames;
+	t_source *src;
 } t_brightness;
 
+typedef struct { // aggregate of a group of cpus
+	unsigned int min;
+	unsigned int avg;
+	unsigned int max;
+	unsigned int hot;   // percent of cpus at or above cpu_hot_load
+	int cpus;           // cpus that reported a value
+} t_cpu_agg;
+
+typedef struct { // cpufreq policy, shared by all its related cpus
+	unsigned int min;
+	unsigned int max;
+	unsigned int cur;
+	t_source src;
+} t_policy;
+
 typedef struct { // clock
-	int num_clocks;
+	int num_policies;
+	t_policy *policies;
+	int num_clocks;     // cpu numbers covered
+	int *policy;        // policy of every cpu number, -1 if none
 	unsigned int clock_min;
 	unsigned int clock_max;
 	unsigned int *clocks;
+	unsigned int *perc; // of the range of the cpu's policy
+	t_cpu_agg *agg;     // per cpu group
+	t_cpu_agg *perc_agg;
 } t_clocks;
 
+enum { CpuUser, CpuNice, CpuSystem, CpuIdle, CpuIowait, CpuIrq, CpuSoftirq, CpuSteal, CpuGuest, CpuGuestNice, CpuFields };
+
 typedef struct { // cpu
-	int num_cpus;
-	unsigned int *user;
-	unsigned int *nice;
-	unsigned int *system;
-	unsigned int *idle;
-	unsigned int *running;
-	unsigned int *total;
-	unsigned int *perc;
+	int num_cpus;                   // online at startup
+	int num_cols;                   // max_id + 1, a column for every cpu number
+	int stride;                     // num_cols + 1, the last column holds the sum of all cpus
+	unsigned long long *jiffies[2]; // CpuFields rows of stride columns, previous and current snapshot
+	int cur;
+	unsigned int *perc;             // perc[num_cols] is the overall load
+	char *online;                   // column was in the previous snapshot
+	int *ids;                       // cpu numbers of the online columns
+	int num_online;
+	int max_id;
+	int *group;                     // group of every cpu number, -1 if unknown
+	int num_groups;
+	t_cpu_agg *load;                // per group
+	t_source src;
 } t_cpus;
 
+#ifdef USE_SIMD
+typedef unsigned long long v4u64 __attribute__((vector_size(32)));
+typedef int v4i __attribute__((vector_size(16)));
+typedef float v4f __attribute__((vector_size(16)));
+#endif
+
 typedef struct { // datetime
 	time_t time;
 } t_date;
 
+typedef struct { // wanted keys of a "key: value" or "key value" procfs file
+	int num;
+	const char **keys;
+	int *lens;
+	t_source src;
+} t_keyed;
+
 typedef struct { // memory
-	unsigned int total;
-	unsigned int free;
-	unsigned int buffers;
-	unsigned int cached;
+	unsigned long long info[NumMemKeys]; // kB
+	unsigned long long vm[NumVmKeys];
+	t_rate swapin;      // pages per second
+	t_rate swapout;
+	t_rate faults;
+	t_rate majfaults;
+	t_keyed meminfo;
+	t_keyed vmstat;
 } t_mem;
 
 #ifdef USE_SOCKETS
 typedef struct {
-	struct hostent* host;
-    struct sockaddr_in sain;
-    struct sockaddr_un saun;
-    int sock;
-    int connected;
-    int domain;
-    FILE* fp;
+	const char *address;    // host name or, without a port, path of a unix socket
+	int port;
+	int tag;                // what the reactor reports when the socket gets ready
+	struct sockaddr_storage addr;
+	socklen_t addrlen;      // 0 until address was resolved, again after a failed connect
+	int sock;               // -1 while closed
+	int state;
+	int pending;            // replies still expected
+	char failed;            // failed since the last reply, the peer counts as down
+	unsigned int watched;   // events the reactor watches the socket for
+	int backoff;            // ms to wait after the next failure
+	unsigned int seed;      // for the jitter of the backoff
+	long long retry;        // CLOCK_MONOTONIC in ms of the next connect
+	long long deadline;     // connect or reply has to be done by then
+	unsigned int head, tail; // write and read position in rx, running freely
+	char rx[CON_RING];
+	char line[BUF_SIZE * 2]; // last line taken out of rx
+	int event;              // socket + 1 the reactor saw get ready, 0 if none (atomic)
 } t_connection;
 
 typedef struct { // music player
@@ -173,17 +329,42 @@ typedef struct { // music player
 	char album[128];
 	char title[128];
 	t_connection con;
-	void (*parse_func)();
+	char valid;         // a reply came in since the last failure
+	char idle;          // the pending reply is to idle
+	unsigned char known; // MpdPlayer, MpdMixer, MpdOptions that are up to date
+	long long elapsed;  // ms played at since, position is moved along from it
+	long long since;    // CLOCK_MONOTONIC in ms of the last state, 0 if not known
 } t_mp;
 #endif
 
+typedef struct { // network interface
+	char name[20];
+	char used;          // 0: free slot, skip it
+	char seen;
+	char up;            // link is up and has a carrier
+	int hpos;           // position in the name hash
+	unsigned long long rx;
+	unsigned long long tx;
+	t_rate rxr;         // bytes per second
+	t_rate txr;
+	unsigned char idle; // reads without traffic (saturating), for formatters
+} t_iface;
+
 typedef struct nwstat { // network
-	int count;
-	unsigned int *rx;
-	unsigned int *tx;
-	unsigned int *lrx;
-	unsigned int *ltx;
-	char **devnames;
+	int count;          // slots, including free ones
+	int used;
+	int size;
+	t_iface *ifaces;
+	int *free_slots;
+	int num_free;
+	int *hash;          // slot by name (-1: empty, -2: tombstone)
+	int hash_size;
+	int tombs;
+	int nl;             // rtnetlink socket for stats dumps (-1: use src)
+	int nl_fails;       // dumps failed in a row, a new socket is tried until NL_RETRIES
+	long long nl_retry; // CLOCK_MONOTONIC in ms when to try a new socket
+	int nl_events;      // rtnetlink socket for link changes
+	t_source src;
 } t_net;
 
 #ifdef USE_NOTIFY
@@ -192,49 +373,212 @@ typedef struct { // notifications
 } t_notify;
 #endif
 
+typedef struct { // temperature channel of a thermal zone or a hwmon chip
+	char name[64];      // zone type, or "chip:label" for hwmon
+	int temp;           // millidegree celsius
+	int warn;           // passive/hot trip point or temp*_max, 0 if unknown
+	int crit;           // critical trip point or temp*_crit, 0 if unknown
+	char ok;            // last read succeeded
+	t_source src;
+} t_therm;
+
 typedef struct { // temperature
 	int num_therms;
-	unsigned int *therms;
+	t_therm **therms;   // sources must not move, they are registered for prefetching
 } t_therms;
 
 typedef struct wstat { // wifi
 	char devname[20];
 	unsigned int wstatus;
 	unsigned int perc;
+	t_source src;
 } t_wifi;
 
-typedef char (*status_f)(char *);
+typedef struct { // uptime, load and memory from one sysinfo() call, no files involved
+	long uptime;                  // seconds
+	unsigned int load[3];         // 1, 5 and 15 minutes, in hundredths
+	unsigned long long ram_total; // bytes
+	unsigned long long ram_free;  // free and buffers, the page cache is not known here
+	unsigned long long swap_total;
+	unsigned long long swap_free;
+	unsigned short procs;
+} t_sysinfo;
+
+typedef struct { // colour fade from 0 to 100 percent, the table is built on first use
+	const char *from;   // rgb like "3f4"
+	const char *to;
+	char (*col)[4];
+} t_gradient;
+
+typedef struct { // value a template can refer to by name
+	const char *name;
+	long (*num)(int i);         // of item i of the enclosing {#list}, NULL if text
+	const char *(*str)(int i);
+	int (*count)();             // number of items if this is a list
+} t_tplvar;
+
+typedef struct { // step of a compiled template
+	char op;
+	short next;         // TplIf, TplIfNot, TplLoop: ops to skip to get behind the block
+	short len;          // TplLit: length, TplStr: max length (0: all)
+	short width;        // TplNum: zero padded to width
+	int mul;            // TplNum: value is multiplied by mul, divided by div, taken
+	int div;            // modulo mod, capped at max, then scaled from 0-100 to 0-bar
+	int mod;
+	int max;
+	int bar;
+	char scaled;        // TplNum: printed with binary units, see aputscaled
+	char cmp;           // TplIf, TplIfNot: '<', '>' or '=' to compare with arg, 0: test for non zero
+	long arg;
+	const char *s;      // TplLit: text, TplTime: strftime format, TplLoop: separator
+	char (*grad)[4];    // TplNum: emit the colour of the value (0-100) instead
+	const t_tplvar *var;
+} t_tplop;
+
+typedef struct { // layout of a segment, compiled on first use
+	const char *src;
+	t_tplop *ops;
+	int num_ops;
+} t_template;
+
+typedef struct { // further rendering of the same readings, written to its own sink
+	const char *sink;   // file that is replaced whenever the view changed
+	t_template *templates; // NUMFUNCS layouts, sensors without one are left out
+	t_status *segments[NUMFUNCS];
+	char dirty;
+} t_view;
+
+#ifdef USE_THREADS
+typedef struct { // sensor read on its own thread, so it can block without holding up the others
+	pthread_t thread;
+	int func;
+	int wake;           // eventfd, the main thread asks for a reading
+	t_status *back;     // the thread formats into this, main copies it into the segment
+	char ok;
+	char busy;          // asked and not yet collected, main thread only
+	long long kicked;   // CLOCK_MONOTONIC in ms when it was asked
+	int refresh;        // format again even if nothing changed (atomic)
+	unsigned int done;  // readings finished, published with release order
+	unsigned int seen;  // readings collected by the main thread
+} t_collector;
+#endif
+
+typedef struct { // scheduler entry
+	long long due;
+	int func;
+} t_deadline;
+
+typedef char (*status_f)(t_status *);
 
 /* function declarations */
 #ifdef USE_ALSAVOL
-static char get_alsavol(char *status);
+static char get_alsavol(t_status *status);
 #endif
 static void check_batteries();
-static char get_battery(char *status);
+static int battery_key(const char *key, int len);
+static int uevent_key(const char *key, int len);
+static int kv_parse(char *buf, int len, int (*key)(const char *key, int len), t_kv *vals, int num);
+static char get_battery(t_status *status);
 static void check_brightness();
-static char get_brightness(char *status);
+static char get_brightness(t_status *status);
 static void check_clocks();
-static char get_clock(char *status);
+static char get_clock(t_status *status);
 static void check_cpus();
-static char get_cpu(char *status);
-static char get_datetime(char *status);
-static char get_mem(char *status);
+static char get_cpu(t_status *status);
+static void cpu_load(const unsigned long long *restrict now, const unsigned long long *restrict old, unsigned int *restrict perc, int n);
+static void cpu_load_scalar(const unsigned long long *restrict now, const unsigned long long *restrict old, unsigned int *restrict perc, int i, int n);
+#ifdef USE_SIMD
+static int cpu_load_simd(const unsigned long long *restrict now, const unsigned long long *restrict old, unsigned int *restrict perc, int n);
+#endif
+static int read_topology(int cpu, const char *name);
+static void aggregate_cpus(const unsigned int *vals, const int *ids, int n, t_cpu_agg *agg, unsigned int hot_at);
+static unsigned int cpu_agg_value(const t_cpu_agg *agg);
+static char get_datetime(t_status *status);
+static void check_mem();
+static char get_mem(t_status *status);
+static char keyed_open(t_keyed *kf, int owner, const char **keys, int num, const char *path);
+static int keyed_read(t_keyed *kf, unsigned long long *vals);
 #ifdef USE_SOCKETS
 static void check_mp();
-static char get_mp();
-static void check_con(t_connection *con);
+static char get_mp(t_status *status);
+static void con_init(t_connection *con, const char *address, int port, int tag);
+static char con_resolve(t_connection *con);
+static void con_close(t_connection *con);
+static void con_fail(t_connection *con, long long now);
+static void con_watch(t_connection *con, unsigned int events);
+static void con_poll(t_connection *con, long long now);
+static char *con_line(t_connection *con);
+static char con_replied(t_connection *con);
+static void con_send(t_connection *con, const char *msg, size_t len, int replies);
+static long long mpd_ms(const char *value);
 static char mp_parse_mpd();
 static char mp_parse_madasul();
 #endif
-static char get_net(char *status);
+static void check_net();
+static char get_net(t_status *status);
+static unsigned int net_hash(const char *name, int len);
+static void net_rehash();
+static t_iface *net_iface(const char *name, int len);
+static void net_sweep();
+static int net_read_proc();
+static int net_read_rtnl();
+static void read_rtnl(int fd);
 #ifdef USE_NOTIFY
-static char get_notification(char *status);
+static char get_notification(t_status *status);
 #endif
 static void check_therms();
-static char get_therm(char *status);
-static char get_wifi(char *status);
+static t_therm *therm_add(const char *name);
+static int read_line(char *buf, int size, const char *fmt, ...);
+static int check_uevent();
+static void read_uevent(int fd);
+static char get_therm(t_status *status);
+static char get_wifi(t_status *status);
+static char get_sysinfo(t_status *status);
 static void die(const char *errstr, ...);
-static int read_clock(int num, char type[3], unsigned int *target);
+static long long now_ms(clockid_t clk);
+static long long sched_next(int func, long long now);
+static void sched_push(int func, long long due);
+static t_deadline sched_pop();
+static void sched_now(int func);
+static void reactor_watch(int fd, int tag, unsigned int events);
+static int read_policy(const char *policy, const char *name, unsigned int *target);
+static double rate_counter(t_rate *r, unsigned long long value, int bits, int tau);
+static double rate_gauge(t_rate *r, double value, int tau);
+static void rate_smooth(t_rate *r, double sample, double dt, int tau);
+static t_status *status_new(size_t size);
+static void status_reset(t_status *st);
+static char status_stale(t_status *st, unsigned long long fp);
+static unsigned long long fp_mix(unsigned long long h, const void *data, size_t n);
+static void aprintf(t_status *st, const char *fmt, ...);
+static void aputs(t_status *st, const char *s);
+static void astrftime(t_status *st, const char *fmt, const struct tm *tm);
+static void aputn(t_status *st, const char *s, size_t n);
+static void aputu(t_status *st, unsigned long long v, int width);
+static void aputi(t_status *st, long long v);
+static void aputscaled(t_status *st, unsigned long long v);
+static void aputdur(t_status *st, long minutes);
+static unsigned int percent(unsigned long long part, unsigned long long whole);
+static int h2i(char c);
+static char (*gradient_table(const char *from, const char *to))[4];
+static const char *gradient(t_gradient *g, int perc);
+static void tpl_render(t_status *st, t_template *tpl);
+static void tpl_compile(t_template *tpl);
+static void tpl_run(t_status *st, const t_tplop *op, const t_tplop *end, int i);
+static char segment_done(int func, char ok);
+static char src_open(t_source *src, int owner, size_t size, const char *fmt, ...);
+static char *src_read(t_source *src);
+static void src_close(t_source *src);
+#ifdef USE_THREADS
+static void collector_start(int func);
+static void *collector_run(void *arg);
+static void collector_kick(t_collector *c, long long now);
+static void budget_check(int func, long long took);
+static char collector_harvest(t_collector *c);
+#endif
+#ifdef USE_URING
+static char uring_init();
+static void uring_prefetch(const char *due);
+#endif
 
 
 /* variables */
@@ -256,6 +600,36 @@ static t_notify notify_stat;
 #endif
 static t_therms therm_stat;
 static t_wifi wifi_stat;
+static t_sysinfo sysinfo_stat;
+
+static t_deadline sched_heap[NUMFUNCS];
+static int sched_len = 0;
+static t_status *segments[NUMFUNCS]; // last output of every sensor
+static char segment_ok[NUMFUNCS];   // last return value of every sensor
+static char event_driven[NUMFUNCS]; // only rescheduled while they have something to show
+static int epoll_fd = -1;
+#ifdef USE_THREADS
+static t_collector *collectors[NUMFUNCS]; // sensors read on their own thread
+static int collect_fd = -1;               // eventfd, a collector finished a reading
+static char slow_reads[NUMFUNCS];         // reads in a row over the budget
+static char segment_stale[NUMFUNCS];      // thread is overdue, the segment is its last reading
+// Sensors whose stat nothing but their get_* touches. Main rediscovers batteries and
+// backlights on uevents and reads notifications itself, those stay on the main thread.
+static const char offloadable[NUMFUNCS] = {
+	[DATETIME] = 1, [CPU] = 1, [MEM] = 1, [CLOCK] = 1, [THERM] = 1, [NET] = 1, [WIFI] = 1, [SYSINFO] = 1,
+#ifdef USE_SOCKETS
+	[MP] = 1,
+#endif
+#ifdef USE_ALSAVOL
+	[AVOL] = 1,
+#endif
+};
+#endif
+#ifdef USE_URING
+static t_uring uring = { -1 };
+static t_source **sources = NULL; // every open source, for uring_prefetch
+static int num_sources = 0;
+#endif
 
 static const status_f statusfuncs[] = {
 	get_datetime,
@@ -267,6 +641,7 @@ static const status_f statusfuncs[] = {
 	get_wifi,
 	get_battery,
     get_brightness,
+	get_sysinfo,
 #ifdef USE_SOCKETS
 	get_mp,
 #endif
@@ -281,62 +656,309 @@ static const status_f statusfuncs[] = {
 
 #include "config.h"
 
+#ifndef NO_VIEWS
+static void view_update(int func, char ok);
+static void view_write(t_view *view);
+#endif
+
+
+t_status *status_new(size_t size) {
+	t_status *st;
+
+	XALLOC(st, t_status, 1);
+	XALLOC(st->buf, char, size);
+	st->size = size;
+
+	return st;
+}
+
+void status_reset(t_status *st) {
+	st->buf[0] = 0;
+	st->len = 0;
+	st->truncated = 0;
+}
+
+// Whether the formatter has to run again, i.e. its inputs (hashed into fp) changed since
+// st was formatted. A stale segment is cleared and marked dirty, a fresh one is left alone.
+char status_stale(t_status *st, unsigned long long fp) {
+	if(st->valid && st->fp==fp)
+		return 0;
+
+	status_reset(st);
+	st->fp = fp;
+	st->valid = 1;
+	st->dirty = 1;
+
+	return 1;
+}
+
+// FNV-1a, fingerprints are built by mixing every input of a formatter into FP_INIT
+unsigned long long fp_mix(unsigned long long h, const void *data, size_t n) {
+	const unsigned char *p = data;
+
+	while(n--)
+		h = (h ^ *p++) * 0x100000001b3ULL;
+
+	return h;
+}
+
+// Appends at the cursor. A piece that does not fit is dropped completely instead of
+// being cut, so no half escape sequence ends up in the status.
+void aprintf(t_status *st, const char *fmt, ...) {
+	va_list ap;
+	int n;
+
+	if(st->truncated)
+		return;
+
+	va_start(ap, fmt);
+	n = vsnprintf(st->buf + st->len, st->size - st->len, fmt, ap);
+	va_end(ap);
+
+	if(n < 0 || (size_t)n >= st->size - st->len) {
+		st->buf[st->len] = 0;
+		st->truncated = 1;
+	} else
+		st->len += n;
+}
+
+void aputs(t_status *st, const char *s) {
+	aputn(st, s, strlen(s));
+}
+
+void aputn(t_status *st, const char *s, size_t n) {
+	if(st->truncated || n >= st->size - st->len) {
+		st->truncated = 1;
+		return;
+	}
+	memcpy(st->buf + st->len, s, n);
+	st->len += n;
+	st->buf[st->len] = 0;
+}
+
+// Number emitters for formatters, they write straight into the buffer without printf
+static const char digit_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// decimal, zero padded to width digits
+void aputu(t_status *st, unsigned long long v, int width) {
+	char buf[24], *p = buf + sizeof(buf);
+
+	// two digits per division
+	while(v>=100) {
+		p -= 2;
+		memcpy(p, digit_pairs + (v % 100) * 2, 2);
+		v /= 100;
+	}
+	if(v>=10) {
+		p -= 2;
+		memcpy(p, digit_pairs + v * 2, 2);
+	} else
+		*--p = '0' + v;
+	while(buf + sizeof(buf) - p < width && p > buf)
+		*--p = '0';
+	aputn(st, p, buf + sizeof(buf) - p);
+}
+
+void aputi(t_status *st, long long v) {
+	if(v<0)
+		aputn(st, "-", 1);
+	aputu(st, v<0 ? -(unsigned long long)v : v, 0);
+}
+
+// bytes with binary units and one decimal: 1023, 1.0K, 15.3M
+void aputscaled(t_status *st, unsigned long long v) {
+	static const char units[] = "KMGTPE";
+	char tail[3] = { '.', 0, 0 };
+	int u = 0;
+
+	if(v<1024) {
+		aputu(st, v, 0);
+		return;
+	}
+	while(v>=1024 * 1024 && u<5) {
+		v >>= 10;
+		u++;
+	}
+	v = (v * 10 + 512) >> 10; // tenths of the unit, rounded
+	if(v>=10240 && u<5) { // rounded up to a whole next unit: 1.0M, not 1024.0K
+		v = 10;
+		u++;
+	}
+	aputu(st, v / 10, 0);
+	tail[1] = '0' + v % 10;
+	tail[2] = units[u];
+	aputn(st, tail, 3);
+}
+
+// h:mm
+void aputdur(t_status *st, long minutes) {
+	if(minutes<0) {
+		aputn(st, "-", 1);
+		minutes = -minutes;
+	}
+	aputu(st, minutes / 60, 0);
+	aputn(st, ":", 1);
+	aputn(st, digit_pairs + (minutes % 60) * 2, 2);
+}
+
+// part of whole in percent, 0 if there is no whole
+unsigned int percent(unsigned long long part, unsigned long long whole) {
+	return whole ? part * 100 / whole : 0;
+}
+
+// strftime returns 0 both for a result that does not fit and for an empty one (%p in
+// some locales), only the first is a truncation
+void astrftime(t_status *st, const char *fmt, const struct tm *tm) {
+	char tmp[BUF_SIZE];
+	size_t n, room = st->size - st->len;
+
+	if(st->truncated || !*fmt)
+		return;
+	if((n = strftime(st->buf + st->len, room, fmt, tm)) > 0) {
+		st->len += n;
+		return;
+	}
+	st->buf[st->len] = 0;
+	if(room < sizeof(tmp) && strftime(tmp, sizeof(tmp), fmt, tm) > 0)
+		st->truncated = 1;
+}
+
+int h2i(char c) {
+	if(c>='0' && c<='9') return c - '0';
+	if(c>='a' && c<='f') return c - 'a' + 10;
+	return 0;
+}
+
+// Colours of an rgb fade at every percent. The channels are blended linearly, then
+// scaled so that the brightest one follows the blend of both brightest channels,
+// which keeps the middle of the fade from turning dull.
+char (*gradient_table(const char *from, const char *to))[4] {
+	char (*col)[4];
+	int fmax = 0, tmax = 0, xmax, perc, i, x, a[3];
+	double val, s;
+
+	for(i=0; i<3; i++) {
+		fmax = MAX(fmax, h2i(from[i]));
+		tmax = MAX(tmax, h2i(to[i]));
+	}
+
+	XALLOC(col, char[4], 101);
+	for(perc=0; perc<=100; perc++) {
+		val = perc / 100.0;
+		for(i=0, xmax=0; i<3; i++) {
+			a[i] = h2i(to[i]) * val + h2i(from[i]) * (1 - val);
+			xmax = MAX(xmax, a[i]);
+		}
+		s = xmax ? (tmax * val + fmax * (1 - val)) / xmax : 0;
+		for(i=0; i<3; i++) {
+			x = MIN(a[i] * s, 15);
+			col[perc][i] = x>9 ? 'a' + x - 10 : '0' + x;
+		}
+	}
+
+	return col;
+}
+
+const char *gradient(t_gradient *g, int perc) {
+	if(g->col==NULL)
+		g->col = gradient_table(g->from, g->to);
+
+	return g->col[perc<0 ? 0 : perc>100 ? 100 : perc];
+}
 
 void check_batteries() {
-	// TODO: the battery count might change on run time?
+	// called again by read_uevent when a battery comes or goes
 	struct dirent **batdirs;
-	int i, nentries = scandir("/sys/class/power_supply/", &batdirs, NULL, alphasort);
+	int i, present, nentries = scandir("/sys/class/power_supply/", &batdirs, NULL, alphasort);
+
+	for(i=0; i<battery_stats.num_bats; i++) {
+		free(battery_stats.name[i]);
+		src_close(&battery_stats.src[i]);
+	}
+	free(battery_stats.state);
+	free(battery_stats.rate);
+	free(battery_stats.remaining);
+	free(battery_stats.capacity);
+	free(battery_stats.name);
+	free(battery_stats.src);
+	memset(&battery_stats, 0, sizeof(t_bateries));
 
 	if(nentries<=2) {
 		for(i=0; i<nentries; i++)
 			free(batdirs[i]);
-		free(batdirs);
+		if(nentries>=0)
+			free(batdirs);
 		return;
 	}
 
-	FILE *fp;
-	char label[32], value[64];
-	char filename[BUF_SIZE];
-	battery_stats.num_bats = -1;
+	t_kv vals[NumBatKeys];
+	t_source *src;
+	char *p;
+	battery_stats.num_bats = 0;
 
-	
 	XALLOC(battery_stats.state, int, nentries - 2);
-	XALLOC(battery_stats.rate, unsigned int, nentries - 2);
-	XALLOC(battery_stats.remaining, unsigned int, nentries - 2);
-	XALLOC(battery_stats.capacity, unsigned int, nentries - 2);
+	XALLOC(battery_stats.rate, long long, nentries - 2);
+	XALLOC(battery_stats.remaining, long long, nentries - 2);
+	XALLOC(battery_stats.capacity, long long, nentries - 2);
 	XALLOC(battery_stats.name, char*, nentries - 2);
+	XALLOC(battery_stats.src, t_source, nentries - 2);
 
 	for(i=0; i<nentries; i++) {
 		if(strlen(batdirs[i]->d_name)>=3 && strncmp("BAT", batdirs[i]->d_name, 3)==0) {
-			sprintf(filename, "/sys/class/power_supply/%s/uevent", batdirs[i]->d_name);
-			fp = fopen(filename, "r");
-
-			if(fp==NULL)
-				continue;
-
-			while(fp && !feof(fp)) {
-				if(fscanf(fp, "%[^=]=%[^\n]\n", label, value) != 2)
-					break;
-
-				if(strncmp(label, "POWER_SUPPLY_PRESENT", 20)==0) {
-					if(strncmp(value, "0", 1)==0) break;  // not present battery is not interesting
-					else {                                // (might be wrong, when battery is added)
-						battery_stats.num_bats++;         // but this loop looks a bit fishy anyway...
-						XALLOC(battery_stats.name[battery_stats.num_bats], char, strlen(batdirs[i]->d_name) + 1);
-						strcpy(battery_stats.name[battery_stats.num_bats], batdirs[i]->d_name);
-					}
-				}
-				if((strncmp(label, "POWER_SUPPLY_ENERGY_FULL", 24)==0 && strlen(label)==24) || (strncmp(label, "POWER_SUPPLY_CHARGE_FULL", 24)==0 && strlen(label)==24)) {
-					battery_stats.capacity[battery_stats.num_bats] = atoi(value);
-					break;
-				}
+			// the uevent file stays open, get_battery re-reads it every tick
+			src = &battery_stats.src[battery_stats.num_bats];
+			src_open(src, BATTERY, BUF_SIZE * 4, "/sys/class/power_supply/%s/uevent", batdirs[i]->d_name);
+			present = 0;
+
+			if((p = src_read(src)) != NULL && kv_parse(p, src->len, battery_key, vals, NumBatKeys)) {
+				// not present battery is not interesting (might be wrong, when battery is added)
+				present = vals[BatKeyPresent].num != 0;
+				battery_stats.capacity[battery_stats.num_bats] = vals[BatKeyEnergyFull].str ? vals[BatKeyEnergyFull].num : vals[BatKeyChargeFull].num;
 			}
-			fclose(fp);
+
+			if(present) {
+				XALLOC(battery_stats.name[battery_stats.num_bats], char, strlen(batdirs[i]->d_name) + 1);
+				strcpy(battery_stats.name[battery_stats.num_bats], batdirs[i]->d_name);
+				battery_stats.num_bats++;
+			} else
+				src_close(src);
 		}
 		free(batdirs[i]);
 	}
 	free(batdirs);
-	battery_stats.num_bats++;
+}
+
+// Messages look like "change@/devices/...\0ACTION=change\0SUBSYSTEM=power_supply\0..."
+void read_uevent(int fd) {
+	static char buf[8192];
+	struct sockaddr_nl sa;
+	socklen_t salen;
+	const char *action, *subsystem;
+	t_kv vals[NumUevKeys];
+	ssize_t len;
+
+	while(salen = sizeof(sa), (len = recvfrom(fd, buf, sizeof(buf) - 1, 0, (struct sockaddr *)&sa, &salen)) > 0) {
+		if(sa.nl_pid != 0) // only trust the kernel
+			continue;
+		buf[len] = 0;
+
+		kv_parse(buf, len, uevent_key, vals, NumUevKeys);
+		action = vals[UevAction].str ? vals[UevAction].str : "";
+		subsystem = vals[UevSubsystem].str ? vals[UevSubsystem].str : "";
+
+		if(strcmp(subsystem, "power_supply")==0) {
+			if(strcmp(action, "add")==0 || strcmp(action, "remove")==0)
+				check_batteries();
+			sched_now(BATTERY);
+		} else if(strcmp(subsystem, "backlight")==0) {
+			if(strcmp(action, "add")==0 || strcmp(action, "remove")==0)
+				check_brightness();
+			sched_now(BRIGHTNESS);
+		}
+	}
 }
 
 void check_brightness() {
@@ -345,16 +967,28 @@ void check_brightness() {
 	struct dirent **brightdirs;
 	int i, ii, val, len, len2, nentries = scandir("/sys/class/backlight/", &brightdirs, NULL, alphasort);
 
+	for(i=0; i<brightness_stat.num_brght; i++) {
+		free(brightness_stat.devnames[i]);
+		src_close(&brightness_stat.src[i]);
+	}
+	free(brightness_stat.brghts);
+	free(brightness_stat.max_brghts);
+	free(brightness_stat.devnames);
+	free(brightness_stat.src);
+	memset(&brightness_stat, 0, sizeof(t_brightness));
+
 	if(nentries<=2) {
 		for(i=0; i<nentries; i++)
 			free(brightdirs[i]);
-		free(brightdirs);
+		if(nentries>=0)
+			free(brightdirs);
 		return;
 	}
 
 	XALLOC(brightness_stat.brghts, int, nentries - 2);
 	XALLOC(brightness_stat.max_brghts, int, nentries - 2);
 	XALLOC(brightness_stat.devnames, char*, nentries - 2);
+	XALLOC(brightness_stat.src, t_source, nentries - 2);
     // brightness_stat.brghts = calloc(sizeof(int), nentries - 2); // at least 2 directory entries are '.' and '..'
     // brightness_stat.max_brghts = calloc(sizeof(int), nentries - 2); // at least 2 directory entries are '.' and '..'
     // brightness_stat.devnames = calloc(sizeof(char*), nentries - 2); // at least 2 directory entries are '.' and '..'
@@ -376,12 +1010,12 @@ void check_brightness() {
             fp = fopen(filename, "r");
 			if(fp==NULL) continue;
             fgets(b, 10, fp);
+			fclose(fp);
             if((val=atoi(b))<1) continue;
             brightness_stat.max_brghts[brightness_stat.num_brght] = val;
-            brightness_stat.devnames[brightness_stat.num_brght] = calloc(sizeof(char), len);
+            src_open(&brightness_stat.src[brightness_stat.num_brght], BRIGHTNESS, 16, "/sys/class/backlight/%s/actual_brightness", brightdirs[i]->d_name);
+            brightness_stat.devnames[brightness_stat.num_brght] = calloc(sizeof(char), len2 + 1);
             strncpy(brightness_stat.devnames[brightness_stat.num_brght++], brightdirs[i]->d_name, len2);
-
-			fclose(fp);
 		}
 		free(brightdirs[i]);
 	}
@@ -390,100 +1024,253 @@ void check_brightness() {
 }
 
 void check_clocks() {
-	struct dirent **clockdirs;
-	int i, nentries = scandir("/sys/devices/system/cpu/", &clockdirs, NULL, alphasort);
+	struct dirent **policydirs;
+	int i, cpu, nentries = scandir("/sys/devices/system/cpu/cpufreq/", &policydirs, NULL, alphasort);
+	static char filename[BUF_SIZE];
+	t_policy *policy;
+	FILE *fp;
+
+	clock_stat.num_clocks = cpu_stat.max_id + 1;
+	XALLOC(clock_stat.policy, int, clock_stat.num_clocks);
+	XALLOC(clock_stat.clocks, unsigned int, clock_stat.num_clocks);
+	XALLOC(clock_stat.perc, unsigned int, clock_stat.num_clocks);
+	XALLOC(clock_stat.agg, t_cpu_agg, cpu_stat.num_groups);
+	XALLOC(clock_stat.perc_agg, t_cpu_agg, cpu_stat.num_groups);
+	for(i=0; i<clock_stat.num_clocks; i++)
+		clock_stat.policy[i] = -1;
 
 	if(nentries<=2) {
 		for(i=0; i<nentries; i++)
-			free(clockdirs[i]);
-		free(clockdirs);
+			free(policydirs[i]);
+		if(nentries>=0)
+			free(policydirs);
 		return;
 	}
 
-	int len;
-	clock_stat.num_clocks = 0;
-
+	// cpus of one policy always run at the same clock, one read per policy is enough
+	XALLOC(clock_stat.policies, t_policy, nentries);
+	clock_stat.clock_min = UINT_MAX;
 	for(i=0; i<nentries; i++) {
-		len = strlen(clockdirs[i]->d_name);
-		if(len>=4 && strncmp("cpu", clockdirs[i]->d_name, 3)==0 && clockdirs[i]->d_name[3]>='0' && clockdirs[i]->d_name[3]<='9') {			
-			if(clock_stat.num_clocks==0) {
-				if(read_clock(clock_stat.num_clocks, "min", &clock_stat.clock_min)==0 || read_clock(clock_stat.num_clocks, "max", &clock_stat.clock_max)==0)
-					return;
+		policy = &clock_stat.policies[clock_stat.num_policies];
+		if(strncmp("policy", policydirs[i]->d_name, 6)==0
+				&& read_policy(policydirs[i]->d_name, "scaling_min_freq", &policy->min)
+				&& read_policy(policydirs[i]->d_name, "scaling_max_freq", &policy->max)) {
+			snprintf(filename, BUF_SIZE, "/sys/devices/system/cpu/cpufreq/%.32s/related_cpus", policydirs[i]->d_name);
+			if((fp = fopen(filename, "r"))!=NULL) {
+				while(fscanf(fp, "%d", &cpu)==1)
+					if(cpu>=0 && cpu<clock_stat.num_clocks)
+						clock_stat.policy[cpu] = clock_stat.num_policies;
+				fclose(fp);
 			}
-			clock_stat.num_clocks++;
+			src_open(&policy->src, CLOCK, 16, "/sys/devices/system/cpu/cpufreq/%s/scaling_cur_freq", policydirs[i]->d_name);
+			if(policy->min<clock_stat.clock_min)
+				clock_stat.clock_min = policy->min;
+			if(policy->max>clock_stat.clock_max)
+				clock_stat.clock_max = policy->max;
+			clock_stat.num_policies++;
 		}
-		free(clockdirs[i]);
+		free(policydirs[i]);
 	}
-	free(clockdirs);
-	clock_stat.clocks = calloc(sizeof(unsigned int), clock_stat.num_clocks);
+	free(policydirs);
+	if(!clock_stat.num_policies)
+		clock_stat.clock_min = 0;
 }
 
 void check_cpus() {
-	FILE *fp = fopen("/proc/stat", "r");
-	unsigned int x;
+	char *buf, *p, possible[BUF_SIZE];
+	int i, j, id, pkg, dieid, core;
+	long long *keys;
 
-	if(fp==NULL)
+	if(!src_open(&cpu_stat.src, CPU, BUF_SIZE * 16, "/proc/stat") || (buf = src_read(&cpu_stat.src)) == NULL)
 		return;
 
-	while(!feof(fp)) {
-		if(fscanf(fp, "cpu%*[0-9] %u %u %u %u", &x, &x, &x, &x) == 4) {
-			cpu_stat.num_cpus++;
+	// offline cpus are missing in /proc/stat and may come online later: there is a column
+	// for every possible cpu number, so nothing has to grow on hotplug
+	for(p = strchr(buf, '\n'); p && strncmp(p + 1, "cpu", 3)==0; p = strchr(p + 1, '\n')) {
+		cpu_stat.num_cpus++;
+		if((id = atoi(p + 4))>cpu_stat.max_id)
+			cpu_stat.max_id = id;
+	}
+	if(read_line(possible, sizeof(possible), "/sys/devices/system/cpu/possible")) { // like 0-7 or 0,2-5
+		for(p = possible + strlen(possible); p>possible && p[-1]>='0' && p[-1]<='9'; p--);
+		cpu_stat.max_id = MAX(cpu_stat.max_id, MIN(atoi(p), 4095));
+	}
+	cpu_stat.num_cols = cpu_stat.max_id + 1;
+	cpu_stat.stride = cpu_stat.num_cols + 1;
+	XALLOC(cpu_stat.jiffies[0], unsigned long long, CpuFields * cpu_stat.stride);
+	XALLOC(cpu_stat.jiffies[1], unsigned long long, CpuFields * cpu_stat.stride);
+	XALLOC(cpu_stat.perc, unsigned int, cpu_stat.stride);
+	XALLOC(cpu_stat.online, char, cpu_stat.stride);
+	XALLOC(cpu_stat.ids, int, cpu_stat.num_cols);
+
+	// topology is read once, the clock thread reads it along. Groups get numbered in order
+	// of their first cpu, cpus that are not there and have no topology get none.
+	for(p = strchr(buf, '\n'); p && strncmp(p + 1, "cpu", 3)==0; p = strchr(p + 1, '\n'))
+		cpu_stat.online[atoi(p + 4)] = 1;
+	XALLOC(cpu_stat.group, int, cpu_stat.num_cols);
+	XALLOC(keys, long long, cpu_stat.num_cols);
+	for(i=0; i<cpu_stat.num_cols; i++) {
+		cpu_stat.group[i] = -1;
+		if(!cpu_stat.online[i] && read_topology(i, "physical_package_id")<0)
+			continue;
+		pkg = read_topology(i, "physical_package_id") & 0xfffff;
+		dieid = read_topology(i, "die_id") & 0xfffff;
+		core = read_topology(i, "core_id") & 0xfffff;
+		switch(cpu_grouping) {
+			case GroupCore:    keys[i] = (long long)pkg << 40 | (long long)dieid << 20 | core; break;
+			case GroupDie:     keys[i] = (long long)pkg << 20 | dieid; break;
+			case GroupPackage: keys[i] = pkg; break;
+			case GroupNode:    keys[i] = read_topology(i, "node"); break;
+			case GroupAll:     keys[i] = 0; break;
+			default:           keys[i] = i; break;
 		}
-		while(!feof(fp) && fgetc(fp)!='\n');
+		for(j=0; j<i && (cpu_stat.group[j]<0 || keys[j]!=keys[i]); j++);
+		cpu_stat.group[i] = j<i ? cpu_stat.group[j] : cpu_stat.num_groups++;
 	}
-
-	XALLOC(cpu_stat.user, unsigned int, cpu_stat.num_cpus);
-	XALLOC(cpu_stat.nice, unsigned int, cpu_stat.num_cpus);
-	XALLOC(cpu_stat.system, unsigned int, cpu_stat.num_cpus);
-	XALLOC(cpu_stat.idle, unsigned int, cpu_stat.num_cpus);
-	XALLOC(cpu_stat.running, unsigned int, cpu_stat.num_cpus);
-	XALLOC(cpu_stat.total, unsigned int, cpu_stat.num_cpus);
-	XALLOC(cpu_stat.perc, unsigned int, cpu_stat.num_cpus);
-
-	fclose(fp);
+	free(keys);
+	// get_cpu seeds every column it sees for the first time
+	memset(cpu_stat.online, 0, cpu_stat.stride);
+	XALLOC(cpu_stat.load, t_cpu_agg, cpu_stat.num_groups);
 }
 
+#ifdef USE_SOCKETS
 void check_mp() {
-	if(!mp_port) { // unix sockets dont have a port
-		mp_stat.con.saun.sun_family = AF_UNIX;
-		strcpy(mp_stat.con.saun.sun_path, mp_adress);
-		mp_stat.con.domain = AF_UNIX;
-	} else { // internet sockets do have a port
-		mp_stat.con.host = gethostbyname(mp_adress);
-		mp_stat.con.sain.sin_family = AF_INET;
-		mp_stat.con.sain.sin_port = htons(mp_port);
-		mp_stat.con.sain.sin_addr = *((struct in_addr *)mp_stat.con.host->h_addr);
-		memset(&(mp_stat.con.sain.sin_zero), 0, 8);
-		mp_stat.con.domain = AF_INET;
+	// nothing is resolved or connected here, get_mp does that without blocking
+	con_init(&mp_stat.con, mp_adress, mp_port, EvMp);
+}
+#endif
+
+void check_net() {
+	struct sockaddr_nl sa;
+
+	src_open(&net_stat.src, NET, BUF_SIZE * 8, "/proc/net/dev");
+	net_rehash();
+
+	// one binary dump per tick instead of parsing /proc/net/dev, if the kernel lets us
+	net_stat.nl = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+	sa.nl_groups = RTMGRP_LINK;
+	if((net_stat.nl_events = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE)) >= 0 &&
+			bind(net_stat.nl_events, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+		close(net_stat.nl_events);
+		net_stat.nl_events = -1;
 	}
 }
 
 void check_therms() {
-	struct dirent **thermdirs;
-	int i, nentries = scandir("/sys/devices/virtual/thermal", &thermdirs, NULL, alphasort);
+	struct dirent **dirs;
+	int i, n, k, nentries, temp;
+	char name[64], label[32], type[16];
+	t_therm *therm;
 
-	if(nentries<=2) {
-		for(i=0; i<nentries; i++)
-			free(thermdirs[i]);
-		free(thermdirs);
-		return;
+	// thermal zones, warn and crit come from the kernel's trip points
+	nentries = scandir("/sys/class/thermal", &dirs, NULL, alphasort);
+	for(i=0; i<nentries; i++) {
+		if(strncmp("thermal_zone", dirs[i]->d_name, 12)==0 && dirs[i]->d_name[12]>='0' && dirs[i]->d_name[12]<='9'
+				&& read_line(name, sizeof(name), "/sys/class/thermal/%s/type", dirs[i]->d_name)
+				&& (therm = therm_add(name))!=NULL) {
+			for(k=0; read_line(type, sizeof(type), "/sys/class/thermal/%s/trip_point_%d_type", dirs[i]->d_name, k); k++) {
+				if(!read_line(label, sizeof(label), "/sys/class/thermal/%s/trip_point_%d_temp", dirs[i]->d_name, k) || (temp = atoi(label))<=0)
+					continue;
+				if(strcmp(type, "critical")==0)
+					therm->crit = temp;
+				else if((strcmp(type, "passive")==0 || strcmp(type, "hot")==0) && (!therm->warn || temp<therm->warn))
+					therm->warn = temp;
+			}
+			src_open(&therm->src, THERM, 16, "/sys/class/thermal/%s/temp", dirs[i]->d_name);
+		}
+		free(dirs[i]);
 	}
+	if(nentries>=0)
+		free(dirs);
 
-	therm_stat.num_therms = 0;
-
+	// hwmon chips (coretemp, k10temp, nvme, ...), one channel per temp*_input
+	nentries = scandir("/sys/class/hwmon", &dirs, NULL, alphasort);
 	for(i=0; i<nentries; i++) {
-		if(strncmp("thermal_zone", thermdirs[i]->d_name, 12)==0 && thermdirs[i]->d_name[12]>='0' && thermdirs[i]->d_name[12]<='9')
-			therm_stat.num_therms++;
-		free(thermdirs[i]);
+		if(strncmp("hwmon", dirs[i]->d_name, 5)==0 && read_line(name, sizeof(name), "/sys/class/hwmon/%s/name", dirs[i]->d_name)) {
+			n = strlen(name);
+			for(k=1; k<=64; k++) {
+				if(!read_line(label, sizeof(label), "/sys/class/hwmon/%s/temp%d_input", dirs[i]->d_name, k))
+					continue;
+				if(!read_line(label, sizeof(label), "/sys/class/hwmon/%s/temp%d_label", dirs[i]->d_name, k))
+					snprintf(label, sizeof(label), "temp%d", k);
+				snprintf(name + n, sizeof(name) - n, ":%s", label);
+				if((therm = therm_add(name))==NULL)
+					continue;
+				if(read_line(label, sizeof(label), "/sys/class/hwmon/%s/temp%d_max", dirs[i]->d_name, k))
+					therm->warn = atoi(label);
+				if(read_line(label, sizeof(label), "/sys/class/hwmon/%s/temp%d_crit", dirs[i]->d_name, k))
+					therm->crit = atoi(label);
+				src_open(&therm->src, THERM, 16, "/sys/class/hwmon/%s/temp%d_input", dirs[i]->d_name, k);
+			}
+			name[n] = 0;
+		}
+		free(dirs[i]);
+	}
+	if(nentries>=0)
+		free(dirs);
+
+	// without a trip point warn a bit below critical, or at therm_warning
+	for(i=0; i<therm_stat.num_therms; i++) {
+		therm = therm_stat.therms[i];
+		if(!therm->warn)
+			therm->warn = therm->crit>therm_warning * 1000 + 10000 ? therm->crit - 10000 : therm_warning * 1000;
+	}
+}
+
+// New channel if name is selected in therm_types. Zone types match entries without
+// a ':', hwmon "chip:label" names only entries with one. A trailing '*' matches any rest.
+t_therm *therm_add(const char *name) {
+	int i, len, hwmon = strchr(name, ':')!=NULL;
+	char *pat;
+	t_therm *therm;
+
+	for(i=0; i<LENGTH(therm_types); i++) {
+		pat = therm_types[i];
+		len = strlen(pat);
+		if(hwmon != (strchr(pat, ':')!=NULL))
+			continue;
+		if(len && pat[len - 1]=='*' ? strncmp(pat, name, len - 1)==0 : strcmp(pat, name)==0)
+			break;
+	}
+	if(i==LENGTH(therm_types))
+		return NULL;
+
+	if((therm_stat.therms = realloc(therm_stat.therms, sizeof(t_therm*) * (therm_stat.num_therms + 1))) == NULL)
+		die("fatal: could not realloc() %u bytes (therms)\n", sizeof(t_therm*) * (therm_stat.num_therms + 1));
+	XALLOC(therm, t_therm, 1);
+	strncpy(therm->name, name, sizeof(therm->name) - 1);
+	therm_stat.therms[therm_stat.num_therms++] = therm;
+
+	return therm;
+}
+
+// Listen to kernel uevents, so hotplugged batteries and backlights are found and
+// changes are shown right away. Returns -1 if there are none (the sensors still poll).
+int check_uevent() {
+	struct sockaddr_nl sa;
+	int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+
+	if(fd < 0)
+		return -1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+	sa.nl_groups = 1; // kernel events (udev rebroadcasts on 2)
+	if(bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+		close(fd);
+		return -1;
 	}
-	free(thermdirs);
-	XALLOC(therm_stat.therms, unsigned int, therm_stat.num_therms);
+
+	return fd;
 }
 
 
 
 #ifdef USE_ALSAVOL
-char get_alsavol(char *status) {
+char get_alsavol(t_status *status) {
 	// Derived from: http://blog.yjl.im/2009/05/get-volumec.html
 	// TODO: we shall read all channels, not only one
 	static const snd_mixer_selem_channel_id_t CHANNEL = SND_MIXER_SCHN_FRONT_LEFT;
@@ -523,420 +1310,1645 @@ char get_alsavol(char *status) {
 
 	snd_mixer_close(h_mixer);
 
-	alsavol_format(status);
+	if(status_stale(status, fp_mix(FP_INIT, &alsavol_stat, sizeof(alsavol_stat))))
+		tpl_render(status, &templates[AVOL]);
 
 	free(sid);
 	return 1;
 }
 #endif
 
-char get_battery(char *status) {
+char get_battery(t_status *status) {
 	int i = 0;
-	static char label[32], value[64];
-	static char filename[BUF_SIZE];
-	FILE *fp;
+	char *p;
+	const char *st;
+	t_kv vals[NumBatKeys];
+	long long rate = 0;
+	unsigned long long fp;
 
 	if(battery_stats.num_bats==0)
 		return 0;
 
 	for(i=0; i<battery_stats.num_bats; i++) {
-		sprintf(filename, "/sys/class/power_supply/%s/uevent", battery_stats.name[i]);
-		fp = fopen(filename, "r");
-		if(fp==NULL)
+		if((p = src_read(&battery_stats.src[i])) == NULL)
 			return 0;
+		kv_parse(p, battery_stats.src[i].len, battery_key, vals, NumBatKeys);
+
+		if((st = vals[BatKeyStatus].str) == NULL)
+			battery_stats.state[i] = BatUnknown;
+		else if(strcmp(st, "Charging")==0)
+			battery_stats.state[i] = BatCharging;
+		else if(strcmp(st, "Discharging")==0)
+			battery_stats.state[i] = BatDischarging;
+		else if(strcmp(st, "Charged")==0 || strcmp(st, "Full")==0)
+			battery_stats.state[i] = BatCharged;
+		else
+			battery_stats.state[i] = BatUnknown;
+
+		// the direction is in the status already
+		if(vals[BatKeyPowerNow].str || vals[BatKeyCurrentNow].str)
+			battery_stats.rate[i] = llabs(vals[BatKeyPowerNow].str ? vals[BatKeyPowerNow].num : vals[BatKeyCurrentNow].num);
+		if(vals[BatKeyEnergyNow].str || vals[BatKeyChargeNow].str)
+			battery_stats.remaining[i] = vals[BatKeyEnergyNow].str ? vals[BatKeyEnergyNow].num : vals[BatKeyChargeNow].num;
+
+		rate += battery_stats.rate[i];
+	}
+	rate_gauge(&battery_stats.total_rate, rate, battery_smoothing);
 
-		while(!feof(fp)) {
-			if(fscanf(fp, "%[^=]=%[^\n]\n", label, value)!=2) {
-				continue;
-			}
+	fp = fp_mix(FP_INIT, battery_stats.state, sizeof(int) * battery_stats.num_bats);
+	fp = fp_mix(fp, battery_stats.rate, sizeof(long long) * battery_stats.num_bats);
+	fp = fp_mix(fp, battery_stats.remaining, sizeof(long long) * battery_stats.num_bats);
+	fp = fp_mix(fp, battery_stats.capacity, sizeof(long long) * battery_stats.num_bats);
+	rate = battery_stats.total_rate.rate;
+	if(status_stale(status, fp_mix(fp, &rate, sizeof(rate))))
+		tpl_render(status, &templates[BATTERY]);
 
-			if(strncmp(label, "POWER_SUPPLY_STATUS", 19)==0) {
-				if(strncmp(value, "Charging", 8)==0)
-					battery_stats.state[i] = BatCharging;
-				else if(strncmp(value, "Discharging", 11)==0)
-					battery_stats.state[i] = BatDischarging;
-				else if(strncmp(value, "Charged", 7)==0 || strncmp(value, "Full", 5)==0)
-					battery_stats.state[i] = BatCharged;
-				else
-					battery_stats.state[i] = BatUnknown;
-			}
-			else if(strncmp(label, "POWER_SUPPLY_POWER_NOW", 23)==0 || strncmp(label, "POWER_SUPPLY_CURRENT_NOW", 25)==0) {
-				battery_stats.rate[i] = atoi(value);
-				if(battery_stats.rate[i] < 0) battery_stats.rate[i]=1;
-			}
-			else if(strncmp(label, "POWER_SUPPLY_ENERGY_NOW", 22)==0 || strncmp(label, "POWER_SUPPLY_CHARGE_NOW", 22)==0) {
-				battery_stats.remaining[i] = atoi(value);
-			}
+	return 1;
+}
 
-		}
+// Field of a POWER_SUPPLY_* key. Length and the second character after the prefix differ
+// for every key we use, so the switch is a perfect hash that the compiler turns into a
+// jump table, and one memcmp confirms the hit.
+int battery_key(const char *key, int len) {
+	static const char *names[NumBatKeys] = {
+		[BatKeyStatus] = "STATUS", [BatKeyPresent] = "PRESENT", [BatKeyPowerNow] = "POWER_NOW",
+		[BatKeyCurrentNow] = "CURRENT_NOW", [BatKeyEnergyNow] = "ENERGY_NOW", [BatKeyChargeNow] = "CHARGE_NOW",
+		[BatKeyEnergyFull] = "ENERGY_FULL", [BatKeyChargeFull] = "CHARGE_FULL",
+	};
+	int f;
+
+	if(len<15 || memcmp(key, "POWER_SUPPLY_", 13)!=0)
+		return -1;
+
+	switch(len << 8 | key[14]) {
+		case 19 << 8 | 'T': f = BatKeyStatus; break;
+		case 20 << 8 | 'R': f = BatKeyPresent; break;
+		case 22 << 8 | 'O': f = BatKeyPowerNow; break;
+		case 23 << 8 | 'N': f = BatKeyEnergyNow; break;
+		case 23 << 8 | 'H': f = BatKeyChargeNow; break;
+		case 24 << 8 | 'U': f = BatKeyCurrentNow; break;
+		case 24 << 8 | 'N': f = BatKeyEnergyFull; break;
+		case 24 << 8 | 'H': f = BatKeyChargeFull; break;
+		default: return -1;
+	}
 
-		fclose(fp);
+	return memcmp(key + 13, names[f], len - 13)==0 && names[f][len - 13]==0 ? f : -1;
+}
+
+// Field of a key in a kernel uevent message, same scheme as battery_key
+int uevent_key(const char *key, int len) {
+	switch(len << 8 | key[0]) {
+		case 6 << 8 | 'A': return memcmp(key, "ACTION", 6)==0 ? UevAction : -1;
+		case 9 << 8 | 'S': return memcmp(key, "SUBSYSTEM", 9)==0 ? UevSubsystem : -1;
+		default: return -1;
 	}
+}
 
-	battery_format(status);
+// Parse KEY=VALUE lines, separated by newlines (sysfs uevent files) or 0 bytes (uevent
+// messages), in place. Values of the keys that key() knows end up in vals, everything
+// else is skipped. buf[len] must be writable. Returns the number of known keys found.
+int kv_parse(char *buf, int len, int (*key)(const char *key, int len), t_kv *vals, int num) {
+	char *p, *eq, *eol, *end = buf + len;
+	int f, n = 0;
 
-	return 1;
+	for(f=0; f<num; f++) {
+		vals[f].str = NULL;
+		vals[f].num = 0;
+	}
+
+	for(p = buf; p < end; p = eol + 1) {
+		for(eol = p; eol < end && *eol!='\n' && *eol; eol++);
+		*eol = 0;
+		if((eq = memchr(p, '=', eol - p)) == NULL || (f = key(p, eq - p)) < 0)
+			continue;
+		vals[f].str = eq + 1;
+		vals[f].num = strtoll(eq + 1, NULL, 10);
+		n++;
+	}
+
+	return n;
 }
 
-char get_brightness(char *status) {
+char get_brightness(t_status *status) {
 	int i, val;
-	static char b[10];
-	static char filename[BUF_SIZE];
-	FILE *fp;
+	char *p;
 
 	if(brightness_stat.num_brght==0)
 		return 0;
 
 	for(i=0; i<brightness_stat.num_brght; i++) {
-		sprintf(filename, "/sys/class/backlight/%s/actual_brightness", brightness_stat.devnames[i]);
-
-		fp = fopen(filename, "r");
-		if(fp==NULL)
+		if((p = src_read(&brightness_stat.src[i])) == NULL)
 			return 0;
 
-        fgets(b, 10, fp);
-
-        if((val=atoi(b))<0) continue;
+        if((val=atoi(p))<0) continue;
         brightness_stat.brghts[i] = val;
-		fclose(fp);
 	}
 
-	brightness_format(status);
+	if(status_stale(status, fp_mix(FP_INIT, brightness_stat.brghts, sizeof(unsigned int) * brightness_stat.num_brght)))
+		tpl_render(status, &templates[BRIGHTNESS]);
 
 	return 1;
 }
 
-char get_clock(char *status) {
+char get_clock(t_status *status) {
 	int i;
+	unsigned long long fp;
+	char *p;
+	t_policy *policy;
 
-	for(i=0; i<clock_stat.num_clocks; i++) {
-		if(read_clock(i, "cur", &clock_stat.clocks[i])==0)
+	for(i=0; i<clock_stat.num_policies; i++) {
+		policy = &clock_stat.policies[i];
+		if((p = src_read(&policy->src)) == NULL)
 			return 0;
+		policy->cur = strtoul(p, NULL, 10);
+	}
+
+	for(i=0; i<clock_stat.num_clocks; i++) {
+		if(clock_stat.policy[i]<0) {
+			clock_stat.clocks[i] = clock_stat.perc[i] = 0;
+			continue;
+		}
+		policy = &clock_stat.policies[clock_stat.policy[i]];
+		clock_stat.clocks[i] = policy->cur;
+		clock_stat.perc[i] = policy->cur>policy->min && policy->max>policy->min ? (policy->cur - policy->min) * 100ULL / (policy->max - policy->min) : 0;
 	}
+	aggregate_cpus(clock_stat.clocks, NULL, clock_stat.num_clocks, clock_stat.agg, 0);
+	aggregate_cpus(clock_stat.perc, NULL, clock_stat.num_clocks, clock_stat.perc_agg, 0);
 
-	clock_format(status);
+	fp = fp_mix(FP_INIT, clock_stat.agg, sizeof(t_cpu_agg) * cpu_stat.num_groups);
+	if(status_stale(status, fp_mix(fp, clock_stat.perc_agg, sizeof(t_cpu_agg) * cpu_stat.num_groups)))
+		tpl_render(status, &templates[CLOCK]);
 
 	return 1;
 }
 
-char get_cpu(char *status) {
-	FILE *fp = fopen("/proc/stat", "r");
+char get_cpu(t_status *status) {
+	char *p = src_read(&cpu_stat.src);
+	unsigned long long *now, *old, v, fp;
+	int f, id, col, n = cpu_stat.stride;
 
-	if(fp==NULL)
+	if(p==NULL)
 		return 0;
 
-	unsigned int running, total;
-	int i;
-
-	// skip first line
-	while(!feof(fp) && fgetc(fp)!='\n');
-
-	for(i=0; i<cpu_stat.num_cpus; i++) {
-		if(fscanf(fp, "cpu%*[0-9] %u %u %u %u", &cpu_stat.user[i], &cpu_stat.nice[i], &cpu_stat.system[i], &cpu_stat.idle[i]) == 4) {
-			running = cpu_stat.user[i] + cpu_stat.nice[i] + cpu_stat.system[i];
-			total = running + cpu_stat.idle[i];
-			cpu_stat.perc[i] = (total - cpu_stat.total[i]) ? ((running - cpu_stat.running[i]) * 100) / (total - cpu_stat.total[i]) : 0;
-			cpu_stat.running[i] = running;
-			cpu_stat.total[i] = total;
+	cpu_stat.cur ^= 1;
+	now = cpu_stat.jiffies[cpu_stat.cur];
+	old = cpu_stat.jiffies[cpu_stat.cur ^ 1];
+
+	// first line is the sum of all cpus, it goes into the last column. The others go into
+	// the column of their cpu number, lines shift as cpus go offline or come back.
+	while(strncmp(p, "cpu", 3)==0) {
+		p += 3;
+		for(id = 0; *p>='0' && *p<='9'; p++)
+			id = id * 10 + (*p - '0');
+		col = p[-1]=='u' ? cpu_stat.num_cols : (id<cpu_stat.num_cols ? id : n);
+		// older kernels have less fields, missing ones stay 0
+		for(f=0; f<CpuFields && col<n; f++) {
+			while(*p==' ')
+				p++;
+			for(v=0; *p>='0' && *p<='9'; p++)
+				v = v * 10 + (*p - '0');
+			now[f * n + col] = v;
 		}
-		while(!feof(fp) && fgetc(fp)!='\n');
+		if(col<n)
+			cpu_stat.online[col] |= 2;
+		if((p = strchr(p, '\n'))==NULL)
+			break;
+		p++;
 	}
-	fclose(fp);
 
-	cpu_format(status);
+	// a missing cpu did not run. One that is new (or everything on the first snapshot) has
+	// nothing to compare with, the counters since boot would overflow the int deltas.
+	for(col=0, cpu_stat.num_online=0; col<n; col++) {
+		if(cpu_stat.online[col]==2)
+			for(f=0; f<CpuFields; f++)
+				old[f * n + col] = now[f * n + col];
+		else if(cpu_stat.online[col]==1)
+			for(f=0; f<CpuFields; f++)
+				now[f * n + col] = old[f * n + col];
+		cpu_stat.online[col] >>= 1;
+		if(cpu_stat.online[col] && col<cpu_stat.num_cols)
+			cpu_stat.ids[cpu_stat.num_online++] = col;
+	}
+	cpu_load(now, old, cpu_stat.perc, n);
+	aggregate_cpus(cpu_stat.perc, cpu_stat.ids, cpu_stat.num_online, cpu_stat.load, cpu_hot_load);
 
-	return 1;
-}
+	fp = fp_mix(FP_INIT, cpu_stat.load, sizeof(t_cpu_agg) * cpu_stat.num_groups);
+	if(status_stale(status, fp_mix(fp, &cpu_stat.perc[cpu_stat.num_cols], sizeof(unsigned int))))
+		tpl_render(status, &templates[CPU]);
 
-char get_datetime(char *status) {
-	datetime_stat.time = time(NULL);
-	datetime_format(status);
 	return 1;
 }
 
-char get_mem(char *status) {
-	FILE *fp = fopen("/proc/meminfo", "r");
-
-	if(fp==NULL)
-		return 0;
-
-	static char label[18];
-	unsigned int value;
+// Load of all columns in one pass, the vector path does four columns at a time and the
+// scalar loop the rest. Deltas of one interval fit in an int, so neither needs branches
+// or 64 bit divisions. Guest time is already accounted in user and nice.
+void cpu_load(const unsigned long long *restrict now, const unsigned long long *restrict old, unsigned int *restrict perc, int n) {
+	int i = 0;
 
-	while(!feof(fp)) {
-		if(fscanf(fp, "%16[^:]: %u kB\n", label, &value)!=2) {
-			fclose(fp);
-			return 0;
-		}
+#ifdef USE_SIMD
+	i = cpu_load_simd(now, old, perc, n);
+#endif
+	cpu_load_scalar(now, old, perc, i, n);
+}
 
-		if(strncmp(label, "MemTotal", 8)==0)
-			mem_stat.total = value;
-		else if(strncmp(label, "MemFree", 7)==0)
-			mem_stat.free = value;
-		else if(strncmp(label, "Buffers", 7)==0)
-			mem_stat.buffers = value;
-		else if(strncmp(label, "Cached", 67)==0) {
-			mem_stat.cached = value;
-			break;
-		}
+void cpu_load_scalar(const unsigned long long *restrict now, const unsigned long long *restrict old, unsigned int *restrict perc, int i, int n) {
+	int busy, idle;
+
+#define D(f) (int)(now[f * n + i] - old[f * n + i])
+	for(; i<n; i++) {
+		busy = D(CpuUser) + D(CpuNice) + D(CpuSystem) + D(CpuIrq) + D(CpuSoftirq) + D(CpuSteal);
+		idle = D(CpuIdle) + D(CpuIowait);
+		// counters going backwards (iowait does) count as 0
+		busy &= -(busy > 0);
+		idle &= -(idle > 0);
+		perc[i] = (int)(busy * 100.0f / (busy + idle + (busy + idle == 0)));
 	}
+#undef D
+}
 
-	fclose(fp);
-
-	mem_format(status);
+#ifdef USE_SIMD
+// The scalar loop on four columns at once with gcc/clang vector types, returns the
+// number of columns done. Comparisons yield -1 for true, hence the masks.
+static inline v4i cpu_delta4(const unsigned long long *now, const unsigned long long *old) {
+	v4u64 a, b;
 
-	return 1;
+	memcpy(&a, now, sizeof(a)); // columns are not aligned to the vector size
+	memcpy(&b, old, sizeof(b));
+	return __builtin_convertvector(a - b, v4i);
 }
 
-#ifdef USE_NOTIFY
-char get_notification(char *status) {
-	int n=0;
-	notify_stat.message = notify_get_message(&n);
+int cpu_load_simd(const unsigned long long *restrict now, const unsigned long long *restrict old, unsigned int *restrict perc, int n) {
+	v4i busy, idle, sum;
+	v4f p;
+	int i;
 
-	if(notify_stat.message!=NULL) {
-		notify_format(status);
-		return 1;
+#define D(f) cpu_delta4(now + f * n + i, old + f * n + i)
+	for(i=0; i+4<=n; i+=4) {
+		busy = D(CpuUser) + D(CpuNice) + D(CpuSystem) + D(CpuIrq) + D(CpuSoftirq) + D(CpuSteal);
+		idle = D(CpuIdle) + D(CpuIowait);
+		busy &= busy > 0;
+		idle &= idle > 0;
+		sum = busy + idle;
+		sum -= sum == 0;
+		p = __builtin_convertvector(busy, v4f) * 100.0f / __builtin_convertvector(sum, v4f);
+		busy = __builtin_convertvector(p, v4i);
+		memcpy(perc + i, &busy, sizeof(busy));
 	}
-	return 0;
+#undef D
+
+	return i;
 }
 #endif
 
-char get_mp(char *status) {
-	if(mp_stat.con.connected!=1) {
-		check_con(&mp_stat.con);
-		if(mp_stat.con.connected!=1)
-			return 0;
-	}
-	
-	if(mp_stat.con.connected==1) {
-		mp_parse();
-		mp_format(status);
+// Topology id (core_id, die_id, physical_package_id or numa node) of a cpu, -1 if unknown
+int read_topology(int cpu, const char *name) {
+	static char filename[BUF_SIZE];
+	struct dirent *d;
+	DIR *dir;
+	FILE *fp;
+	int id = -1;
+
+	if(strcmp(name, "node")==0) {
+		snprintf(filename, BUF_SIZE, "/sys/devices/system/cpu/cpu%d", cpu);
+		if((dir = opendir(filename))==NULL)
+			return -1;
+		while((d = readdir(dir))!=NULL) {
+			if(strncmp(d->d_name, "node", 4)==0 && d->d_name[4]>='0' && d->d_name[4]<='9') {
+				id = atoi(d->d_name + 4);
+				break;
+			}
+		}
+		closedir(dir);
+		return id;
 	}
-	
-	return 1;
+
+	snprintf(filename, BUF_SIZE, "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+	if((fp = fopen(filename, "r"))==NULL)
+		return -1;
+	if(fscanf(fp, "%d", &id)!=1)
+		id = -1;
+	fclose(fp);
+	return id;
 }
 
-char get_net(char *status) {
-	FILE *fp = fopen("/proc/net/dev", "r");
-	unsigned int ch=0, ons = net_stat.count, i;
+// Min, avg and max of per cpu values (indexed by cpu number) of the n cpus in ids, or of
+// the first n if it is NULL, for every cpu group, so formatters only do work per group.
+// hot_at 0 makes hot the max.
+void aggregate_cpus(const unsigned int *vals, const int *ids, int n, t_cpu_agg *agg, unsigned int hot_at) {
+	int i, g, id;
 
-	if(fp==NULL)
-		return 0;
+	for(g=0; g<cpu_stat.num_groups; g++) {
+		agg[g].min = UINT_MAX;
+		agg[g].avg = agg[g].max = agg[g].hot = 0;
+		agg[g].cpus = 0;
+	}
 
-	net_stat.count = 0;
-	while(!feof(fp)) {
-		while((ch=fgetc(fp)) != '\n' && ch!=EOF);
-		if(ch!=EOF) net_stat.count++;
-	}
-	net_stat.count -= 2; // 2 header lines
-
-	if(ons!=net_stat.count) {
-		if(ons > 0) {
-			for(i=0; i<ons; i++)
-				free(net_stat.devnames[i]);
-			free(net_stat.devnames);
-			free(net_stat.tx);
-			free(net_stat.rx);
-			free(net_stat.ltx);
-			free(net_stat.lrx);
-		}
-		if(net_stat.count > 0) {
-			XALLOC(net_stat.devnames, char*, net_stat.count);
-			for(i=0; i<net_stat.count; i++)
-				XALLOC(net_stat.devnames[i], char, 20);
-			XALLOC(net_stat.tx, unsigned int, net_stat.count);
-			XALLOC(net_stat.rx, unsigned int, net_stat.count);
-			XALLOC(net_stat.ltx, unsigned int, net_stat.count);
-			XALLOC(net_stat.lrx, unsigned int, net_stat.count);
+	for(i=0; i<n; i++) {
+		id = ids ? ids[i] : i;
+		if(id>cpu_stat.max_id || (g = cpu_stat.group[id])<0)
+			continue;
+		if(vals[id]<agg[g].min)
+			agg[g].min = vals[id];
+		if(vals[id]>agg[g].max)
+			agg[g].max = vals[id];
+		agg[g].avg += vals[id];
+		agg[g].hot += hot_at && vals[id]>=hot_at;
+		agg[g].cpus++;
+	}
+
+	for(g=0; g<cpu_stat.num_groups; g++) {
+		if(!agg[g].cpus) {
+			agg[g].min = 0;
+			continue;
 		}
+		agg[g].avg /= agg[g].cpus;
+		agg[g].hot = hot_at ? agg[g].hot * 100 / agg[g].cpus : agg[g].max;
 	}
+}
 
-	if(net_stat.count>0) {
-		rewind(fp);
+unsigned int cpu_agg_value(const t_cpu_agg *agg) {
+	switch(cpu_aggregate) {
+		case AggMin: return agg->min;
+		case AggMax: return agg->max;
+		case AggHot: return agg->hot;
+		default:     return agg->avg;
+	}
+}
 
-		while((ch=fgetc(fp)) != '\n' && ch!=EOF);
-		while((ch=fgetc(fp)) != '\n' && ch!=EOF);  // skip 2 header lines
+char get_datetime(t_status *status) {
+	datetime_stat.time = time(NULL);
+	if(status_stale(status, fp_mix(FP_INIT, &datetime_stat.time, sizeof(time_t))))
+		tpl_render(status, &templates[DATETIME]);
+	return 1;
+}
 
-		i = 0;
-		while(!feof(fp) && i<net_stat.count) {
-			net_stat.ltx[i] = net_stat.tx[i];
-			net_stat.lrx[i] = net_stat.rx[i];
-			if(fscanf(fp, " %19[^:]: %u %*u %*u %*u %*u %*u %*u %*u %u %*u %*u %*u %*u %*u %*u %*u\n", net_stat.devnames[i], &net_stat.rx[i], &net_stat.tx[i]) != 3) {
-				fclose(fp);
-				return 0;
-			}
-			i++;
-		}
-	} else {
-		fclose(fp);
+char get_mem(t_status *status) {
+	int shown[6];
+
+	// kernels before 3.14 have no MemAvailable, keyed_read would keep the fallback of
+	// the last tick in it
+	mem_stat.info[MemAvailable] = 0;
+	if(keyed_read(&mem_stat.meminfo, mem_stat.info) < 0)
 		return 0;
-	}
 
-	fclose(fp);
+	if(!mem_stat.info[MemAvailable])
+		mem_stat.info[MemAvailable] = mem_stat.info[MemFree] + mem_stat.info[MemBuffers] + mem_stat.info[MemCached];
+
+	if(keyed_read(&mem_stat.vmstat, mem_stat.vm) == NumVmKeys) {
+		rate_counter(&mem_stat.swapin, mem_stat.vm[VmPswpin], 64, rate_smoothing);
+		rate_counter(&mem_stat.swapout, mem_stat.vm[VmPswpout], 64, rate_smoothing);
+		rate_counter(&mem_stat.faults, mem_stat.vm[VmPgfault], 64, rate_smoothing);
+		rate_counter(&mem_stat.majfaults, mem_stat.vm[VmPgmajfault], 64, rate_smoothing);
+	}
 
-	net_format(status);
+	// only what formatters show, free memory in kB changes on nearly every read
+	shown[0] = percent(mem_stat.info[MemAvailable], mem_stat.info[MemTotal]);
+	shown[1] = percent(mem_stat.info[MemSwapTotal] - mem_stat.info[MemSwapFree], mem_stat.info[MemSwapTotal]);
+	shown[2] = mem_stat.swapin.rate;
+	shown[3] = mem_stat.swapout.rate;
+	shown[4] = mem_stat.faults.rate;
+	shown[5] = mem_stat.majfaults.rate;
+	if(status_stale(status, fp_mix(FP_INIT, shown, sizeof(shown))))
+		tpl_render(status, &templates[MEM]);
 
 	return 1;
 }
 
-char get_therm(char *status) {
-	static char filename[BUF_SIZE];
+void check_mem() {
+	static const char *meminfo_keys[NumMemKeys] = {
+		[MemTotal] = "MemTotal", [MemFree] = "MemFree", [MemAvailable] = "MemAvailable", [MemBuffers] = "Buffers",
+		[MemCached] = "Cached", [MemSwapTotal] = "SwapTotal", [MemSwapFree] = "SwapFree",
+	};
+	static const char *vmstat_keys[NumVmKeys] = {
+		[VmPswpin] = "pswpin", [VmPswpout] = "pswpout", [VmPgfault] = "pgfault", [VmPgmajfault] = "pgmajfault",
+	};
+
+	keyed_open(&mem_stat.meminfo, MEM, meminfo_keys, NumMemKeys, "/proc/meminfo");
+	keyed_open(&mem_stat.vmstat, MEM, vmstat_keys, NumVmKeys, "/proc/vmstat");
+}
+
+char keyed_open(t_keyed *kf, int owner, const char **keys, int num, const char *path) {
 	int i;
 
-	for(i=0; i<therm_stat.num_therms; i++) {
-		snprintf(filename, BUF_SIZE, "/sys/devices/virtual/thermal/thermal_zone%d/temp", i);
+	kf->num = num < 64 ? num : 63;
+	kf->keys = keys;
+	XALLOC(kf->lens, int, kf->num);
+	for(i=0; i<kf->num; i++)
+		kf->lens[i] = strlen(keys[i]);
 
-		FILE *fp = fopen(filename, "r");
-		if(fp==NULL)
-			return 0;
+	return src_open(&kf->src, owner, BUF_SIZE * 8, "%s", path);
+}
 
-		if(fscanf(fp, "%u", &therm_stat.therms[i]) != 1) {
-			fclose(fp);
-			return 0;
+// Read the values of the wanted keys into vals (same order as the keys). Lines are found
+// with memchr and the scan stops as soon as every key was seen, keys that are missing
+// keep their old value. Returns the number of keys found, -1 if the file can't be read.
+int keyed_read(t_keyed *kf, unsigned long long *vals) {
+	char *p, *eol, *end;
+	unsigned long long left = (1ULL << kf->num) - 1;
+	int i, n = 0;
+
+	if((p = src_read(&kf->src)) == NULL)
+		return -1;
+
+	for(end = p + kf->src.len; left && p < end; p = eol + 1) {
+		if((eol = memchr(p, '\n', end - p)) == NULL)
+			eol = end;
+		for(i=0; i<kf->num; i++) {
+			if(!(left >> i & 1) || eol - p <= kf->lens[i] || memcmp(p, kf->keys[i], kf->lens[i])!=0
+					|| (p[kf->lens[i]]!=':' && p[kf->lens[i]]!=' '))
+				continue;
+			vals[i] = strtoull(p + kf->lens[i] + 1, NULL, 10);
+			left &= ~(1ULL << i);
+			n++;
+			break;
 		}
-		fclose(fp);
 	}
 
-	therm_format(status);
+	return n;
+}
+
+#ifdef USE_NOTIFY
+char get_notification(t_status *status) {
+	int n=0;
+	time_t now;
+	notify_stat.message = notify_get_message(&n);
+
+	// the marquee moves every second, so the time is an input too
+	if(notify_stat.message!=NULL) {
+		now = time(NULL);
+		if(status_stale(status, fp_mix(fp_mix(FP_INIT, &notify_stat.message, sizeof(notification*)), &now, sizeof(now))))
+			tpl_render(status, &templates[NOTIFY]);
+		return 1;
+	}
+	return 0;
+}
+#endif
+
+#ifdef USE_SOCKETS
+char get_mp(t_status *status) {
+	// never waits for the player: a query goes out and the reactor wakes us up again for
+	// the reply, the last reading is shown meanwhile
+	long long now = now_ms(CLOCK_MONOTONIC);
+	t_connection *con = &mp_stat.con;
+
+	con_poll(con, now);
+	if(mp_parse())
+		mp_stat.valid = 1;
+	if(con->pending && (con->state==ConClosed || now>=con->deadline))
+		con_fail(con, now); // dropped us or stopped answering in the middle of a reply
+	if(con->failed)
+		mp_stat.valid = 0;
+	if(mp_stat.since) { // playing on since the player last told us
+		mp_stat.position = (mp_stat.elapsed + (mp_stat.status==1 ? now - mp_stat.since : 0)) / 1000;
+		if(mp_stat.duration > 0)
+			mp_stat.position = MIN(mp_stat.position, mp_stat.duration);
+	}
+
+	if(!mp_stat.valid)
+		return 0;
+	if(con->pending && !mp_stat.idle) // halfway through the replies, keep the last reading
+		return 1;
+	if(status_stale(status, fp_mix(FP_INIT, &mp_stat, offsetof(t_mp, con))))
+		tpl_render(status, &templates[MP]);
 
 	return 1;
 }
+#endif
 
-char get_wifi(char *status) {
-	FILE *fp = fopen("/proc/net/wireless", "r");
+char get_net(t_status *status) {
+	int i, n = 0, rate[2];
+	unsigned long long fp = FP_INIT;
+	t_iface *iface;
+
+	// a failed dump (no answer right away, ENOBUFS, ..) leaves the socket with half a
+	// reply in it: /proc/net/dev for this tick, a new socket after a doubling wait
+	if(net_stat.nl < 0 && net_stat.nl_fails && net_stat.nl_fails < NL_RETRIES && now_ms(CLOCK_MONOTONIC) >= net_stat.nl_retry)
+		net_stat.nl = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if(net_stat.nl >= 0 && (n = net_read_rtnl()) < 0) {
+		close(net_stat.nl);
+		net_stat.nl = -1;
+		net_stat.nl_retry = now_ms(CLOCK_MONOTONIC) + (1000LL << MIN(net_stat.nl_fails, 6));
+		if(++net_stat.nl_fails==NL_RETRIES)
+			fprintf(stderr, "statinator4k: rtnetlink dumps keep failing, reading /proc/net/dev from now on\n");
+	} else if(net_stat.nl >= 0)
+		net_stat.nl_fails = 0;
+	if((net_stat.nl >= 0 ? n : net_read_proc()) <= 0)
+		return 0;
 
-	if(fp==NULL)
+	for(i=0; i<net_stat.count; i++) {
+		iface = &net_stat.ifaces[i];
+		if(!iface->used)
+			continue;
+		rate[0] = iface->rxr.rate;
+		rate[1] = iface->txr.rate;
+		if(rate[0] || rate[1])
+			iface->idle = 0;
+		else if(iface->idle<255)
+			iface->idle++;
+		fp = fp_mix(fp, iface->name, strlen(iface->name));
+		fp = fp_mix(fp, &iface->up, 1);
+		fp = fp_mix(fp, &iface->idle, 1);
+		fp = fp_mix(fp, rate, sizeof(rate));
+	}
+
+	if(status_stale(status, fp))
+		tpl_render(status, &templates[NET]);
+
+	return 1;
+}
+
+// FNV-1a of an interface name
+unsigned int net_hash(const char *name, int len) {
+	unsigned int h = 2166136261u;
+
+	while(len--)
+		h = (h ^ (unsigned char)*name++) * 16777619u;
+	return h;
+}
+
+// (Re)build the name hash for the slots in use, which also drops all tombstones
+void net_rehash() {
+	unsigned int i, size = 16;
+	int s;
+
+	while(size < (net_stat.used + 1) * 4)
+		size *= 2;
+	free(net_stat.hash);
+	if((net_stat.hash = malloc(sizeof(int) * size)) == NULL)
+		die("fatal: could not malloc() %u bytes (net_stat.hash)\n", sizeof(int) * size);
+	for(i=0; i<size; i++)
+		net_stat.hash[i] = -1;
+	net_stat.hash_size = size;
+	net_stat.tombs = 0;
+
+	for(s=0; s<net_stat.count; s++) {
+		if(!net_stat.ifaces[s].used)
+			continue;
+		for(i = net_hash(net_stat.ifaces[s].name, strlen(net_stat.ifaces[s].name)) & (size - 1); net_stat.hash[i] != -1; i = (i + 1) & (size - 1));
+		net_stat.hash[i] = s;
+		net_stat.ifaces[s].hpos = i;
+	}
+}
+
+// Slot of the interface called name (not 0-terminated), a new one if it is not known
+// yet. Slots keep their index (and history) as long as the interface exists, a freed
+// slot is cleared before it is reused.
+t_iface *net_iface(const char *name, int len) {
+	unsigned int i, mask;
+	int s, tomb = -1;
+	t_iface *iface;
+
+	if(len >= (int)sizeof(iface->name))
+		len = sizeof(iface->name) - 1;
+	if((net_stat.used + net_stat.tombs + 1) * 4 > net_stat.hash_size * 3)
+		net_rehash();
+
+	mask = net_stat.hash_size - 1;
+	for(i = net_hash(name, len) & mask; (s = net_stat.hash[i]) != -1; i = (i + 1) & mask) {
+		if(s == -2) {
+			if(tomb < 0) tomb = i;
+		} else if(strncmp(net_stat.ifaces[s].name, name, len)==0 && net_stat.ifaces[s].name[len]==0)
+			return &net_stat.ifaces[s];
+	}
+	if(tomb >= 0) {
+		i = tomb;
+		net_stat.tombs--;
+	}
+
+	if(net_stat.num_free > 0)
+		s = net_stat.free_slots[--net_stat.num_free];
+	else {
+		if(net_stat.count == net_stat.size) {
+			net_stat.size = net_stat.size ? net_stat.size * 2 : 16;
+			if((net_stat.ifaces = realloc(net_stat.ifaces, sizeof(t_iface) * net_stat.size)) == NULL ||
+					(net_stat.free_slots = realloc(net_stat.free_slots, sizeof(int) * net_stat.size)) == NULL)
+				die("fatal: could not realloc() %u interfaces\n", net_stat.size);
+			memset(net_stat.ifaces + net_stat.count, 0, sizeof(t_iface) * (net_stat.size - net_stat.count));
+		}
+		s = net_stat.count++;
+	}
+
+	iface = &net_stat.ifaces[s];
+	memset(iface, 0, sizeof(t_iface));
+	iface->used = 1;
+	iface->hpos = i;
+	memcpy(iface->name, name, len);
+	net_stat.hash[i] = s;
+	net_stat.used++;
+
+	return iface;
+}
+
+// Drop every interface that was not seen since the last call
+void net_sweep() {
+	int s;
+
+	for(s=0; s<net_stat.count; s++) {
+		if(!net_stat.ifaces[s].used)
+			continue;
+		if(!net_stat.ifaces[s].seen) {
+			net_stat.hash[net_stat.ifaces[s].hpos] = -2;
+			net_stat.tombs++;
+			net_stat.used--;
+			net_stat.ifaces[s].used = 0;
+			net_stat.free_slots[net_stat.num_free++] = s;
+		}
+		net_stat.ifaces[s].seen = 0;
+	}
+}
+
+// fallback without rtnetlink, knows nothing about the link state
+int net_read_proc() {
+	char *p = src_read(&net_stat.src), *e, *c;
+	t_iface *iface;
+	int f;
+
+	if(p==NULL || (p = strchr(p, '\n')) == NULL || (p = strchr(p + 1, '\n')) == NULL)  // skip 2 header lines
 		return 0;
 
-	unsigned int ch = 0;
+	for(p++; (e = strchr(p, '\n')); p = e + 1) {
+		p += strspn(p, " ");
+		if((c = memchr(p, ':', e - p)) == NULL)
+			return 0;
+		iface = net_iface(p, c - p);
+		iface->seen = 1;
+		iface->up = 1;
+		iface->rx = strtoull(c + 1, &p, 10);
+		for(f=0; f<7; f++)  // packets errs drop fifo frame compressed multicast
+			strtoull(p, &p, 10);
+		iface->tx = strtoull(p, &p, 10);
+		rate_counter(&iface->rxr, iface->rx, 64, rate_smoothing);
+		rate_counter(&iface->txr, iface->tx, 64, rate_smoothing);
+	}
+	net_sweep();
 
-	while((ch=fgetc(fp)) != '\n' && ch!=EOF);  // skip 2 header lines
-	while((ch=fgetc(fp)) != '\n' && ch!=EOF);
-	if(fscanf(fp, "%19s %u %u", wifi_stat.devname, &wifi_stat.wstatus, &wifi_stat.perc) != 3) {
-		fclose(fp);
+	return net_stat.used;
+}
+
+// Dump all links with their 64 bit counters and flags in one request. The number of
+// interfaces, -1 if the dump failed.
+int net_read_rtnl() {
+	static char buf[32768]; // dump replies are at most 32k each
+	static unsigned int seq = 0;
+	struct { struct nlmsghdr nh; struct ifinfomsg ifi; } req;
+	struct rtnl_link_stats64 st;
+	struct nlmsghdr *nh;
+	struct ifinfomsg *ifi;
+	struct rtattr *rta;
+	t_iface *iface;
+	char *name;
+	ssize_t n;
+	int done = 0, alen;
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len = sizeof(req);
+	req.nh.nlmsg_type = RTM_GETLINK;
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nh.nlmsg_seq = ++seq;
+	req.ifi.ifi_family = AF_UNSPEC;
+	if(send(net_stat.nl, &req, sizeof(req), MSG_DONTWAIT) < 0)
+		return -1;
+
+	// the kernel fills the dump in while it is read, there is nothing to wait for: this
+	// runs on the main loop and must not block it
+	while(!done) {
+		if((n = recv(net_stat.nl, buf, sizeof(buf), MSG_DONTWAIT)) <= 0)
+			return -1;
+
+		for(nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, n); nh = NLMSG_NEXT(nh, n)) {
+			if(nh->nlmsg_seq != seq)
+				continue;
+			if(nh->nlmsg_type == NLMSG_DONE)
+				done = 1;
+			else if(nh->nlmsg_type == NLMSG_ERROR)
+				return -1;
+			if(nh->nlmsg_type != RTM_NEWLINK)
+				continue;
+
+			ifi = NLMSG_DATA(nh);
+			name = NULL;
+			memset(&st, 0, sizeof(st));
+			alen = IFLA_PAYLOAD(nh);
+			for(rta = IFLA_RTA(ifi); RTA_OK(rta, alen); rta = RTA_NEXT(rta, alen)) {
+				if(rta->rta_type == IFLA_IFNAME)
+					name = RTA_DATA(rta);
+				else if(rta->rta_type == IFLA_STATS64)
+					memcpy(&st, RTA_DATA(rta), MIN(sizeof(st), RTA_PAYLOAD(rta)));
+			}
+			if(name==NULL)
+				continue;
+
+			iface = net_iface(name, strlen(name));
+			iface->seen = 1;
+			iface->up = (ifi->ifi_flags & IFF_UP) && (ifi->ifi_flags & IFF_RUNNING);
+			iface->rx = st.rx_bytes;
+			iface->tx = st.tx_bytes;
+			rate_counter(&iface->rxr, iface->rx, 64, rate_smoothing);
+			rate_counter(&iface->txr, iface->tx, 64, rate_smoothing);
+		}
+	}
+	net_sweep();
+
+	return net_stat.used;
+}
+
+// A link changed (carrier, up/down, new or gone), show it right away
+void read_rtnl(int fd) {
+	static char buf[8192];
+
+	while(recv(fd, buf, sizeof(buf), 0) > 0);
+	sched_now(NET);
+}
+
+char get_therm(t_status *status) {
+	int i, ok = 0;
+	unsigned long long fp = FP_INIT;
+	char *p;
+	t_therm *therm;
+
+	// a single broken channel must not hide the others
+	for(i=0; i<therm_stat.num_therms; i++) {
+		therm = therm_stat.therms[i];
+		if((therm->ok = (p = src_read(&therm->src)) != NULL)) {
+			therm->temp = atoi(p);
+			ok++;
+		}
+	}
+
+	if(!ok)
 		return 0;
+
+	for(i=0; i<therm_stat.num_therms; i++) {
+		therm = therm_stat.therms[i];
+		fp = fp_mix(fp, &therm->ok, 1);
+		fp = fp_mix(fp, &therm->temp, sizeof(int));
 	}
-	fclose(fp);
+	if(status_stale(status, fp))
+		tpl_render(status, &templates[THERM]);
 
-	wifi_stat.devname[strlen(wifi_stat.devname)-1] = 0;
-	wifi_format(status);
+	return 1;
+}
+
+char get_sysinfo(t_status *status) {
+	struct sysinfo si;
+	int i, perc;
+	long up;
+	unsigned long long fp;
+
+	if(sysinfo(&si)!=0)
+		return 0;
+
+	sysinfo_stat.uptime = si.uptime;
+	for(i=0; i<3; i++)
+		sysinfo_stat.load[i] = (si.loads[i] * 100 + (1 << (SI_LOAD_SHIFT - 1))) >> SI_LOAD_SHIFT;
+	sysinfo_stat.ram_total = (unsigned long long)si.totalram * si.mem_unit;
+	sysinfo_stat.ram_free = ((unsigned long long)si.freeram + si.bufferram) * si.mem_unit;
+	sysinfo_stat.swap_total = (unsigned long long)si.totalswap * si.mem_unit;
+	sysinfo_stat.swap_free = (unsigned long long)si.freeswap * si.mem_unit;
+	sysinfo_stat.procs = si.procs;
+
+	// uptime is shown in minutes, memory in percent
+	up = sysinfo_stat.uptime / 60;
+	perc = sysinfo_stat.ram_total ? sysinfo_stat.ram_free * 100 / sysinfo_stat.ram_total : 0;
+	fp = fp_mix(FP_INIT, sysinfo_stat.load, sizeof(sysinfo_stat.load));
+	fp = fp_mix(fp_mix(fp, &up, sizeof(up)), &perc, sizeof(perc));
+	if(status_stale(status, fp))
+		tpl_render(status, &templates[SYSINFO]);
 
 	return 1;
 }
 
+char get_wifi(t_status *status) {
+	char *p = src_read(&wifi_stat.src);
 
-void check_con(t_connection *con) {
-    int flags, stat;
+	if(p==NULL)
+		return 0;
 
-    if((con->sock = socket(con->domain, SOCK_STREAM, 0)) < 0) {
-        printf("sock fail\n");
-		con->connected = 0;
-        return;
-    }
+	// skip 2 header lines
+	if((p = strchr(p, '\n')) == NULL || (p = strchr(p + 1, '\n')) == NULL)
+		return 0;
+	if(sscanf(p + 1, "%19s %u %u", wifi_stat.devname, &wifi_stat.wstatus, &wifi_stat.perc) != 3)
+		return 0;
 
-    if(con->domain == AF_INET)
-    	stat = connect(con->sock, (struct sockaddr *)&con->sain, sizeof(struct sockaddr));
-    else
-    	stat = connect(con->sock, (struct sockaddr *)&con->saun, sizeof(con->saun.sun_family) + strlen(con->saun.sun_path));
-    if(stat < 0) {
-        close(con->sock);
-		con->connected = 0;
-        return;
-    }
+	wifi_stat.devname[strlen(wifi_stat.devname)-1] = 0;
+	if(status_stale(status, fp_mix(fp_mix(FP_INIT, wifi_stat.devname, strlen(wifi_stat.devname)), &wifi_stat.perc, sizeof(unsigned int))))
+		tpl_render(status, &templates[WIFI]);
 
-	flags = fcntl(con->sock, F_GETFL, 0);
-	fcntl(con->sock, F_SETFL, flags | O_NONBLOCK);
+	return 1;
+}
 
-    con->connected = 1;
 
-	con->fp = fdopen(con->sock, "r");
+#ifdef USE_SOCKETS
+void con_init(t_connection *con, const char *address, int port, int tag) {
+	memset(con, 0, sizeof(*con));
+	con->address = address;
+	con->port = port;
+	con->tag = tag;
+	con->sock = -1;
+	con->state = ConClosed;
+	con->backoff = con_backoff_min;
+	con->seed = getpid();
 }
 
-char mp_parse_mpd() {
-    static const char cmd[] = "status\ncurrentsong\n";
-	static char type[128], value[128];
-	char *dp;
-
-    if(send(mp_stat.con.sock, cmd, strlen(cmd), MSG_NOSIGNAL)<0) {
-		mp_stat.con.connected = 0;
-		close(mp_stat.con.sock);
-		fclose(mp_stat.con.fp);
+// Looks the address up once, it is only looked up again after a connect failed
+char con_resolve(t_connection *con) {
+	struct addrinfo hints, *res;
+	struct sockaddr_un *un = (struct sockaddr_un *)&con->addr;
+	char port[8];
+
+	if(con->addrlen)
+		return 1;
+
+	if(!con->port) { // unix sockets dont have a port
+		un->sun_family = AF_UNIX;
+		snprintf(un->sun_path, sizeof(un->sun_path), "%s", con->address);
+		con->addrlen = offsetof(struct sockaddr_un, sun_path) + strlen(un->sun_path) + 1;
+		return 1;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+	snprintf(port, sizeof(port), "%d", con->port);
+	if(getaddrinfo(con->address, port, &hints, &res))
 		return 0;
+	memcpy(&con->addr, res->ai_addr, res->ai_addrlen);
+	con->addrlen = res->ai_addrlen;
+	freeaddrinfo(res);
+
+	return 1;
+}
+
+// Closing keeps what was received, the reply may still be parsed
+void con_close(t_connection *con) {
+	if(con->sock >= 0)
+		close(con->sock);
+	con->sock = -1;
+	con->state = ConClosed;
+	con->watched = 0;
+}
+
+// Waits twice as long as the last time (plus up to half of it) until connecting again,
+// so a player that is gone is not hammered on every tick
+void con_fail(t_connection *con, long long now) {
+	con_close(con);
+	con->failed = 1;
+	con->pending = 0;
+	con->addrlen = 0;
+	con->retry = now + con->backoff + rand_r(&con->seed) % (con->backoff / 2 + 1);
+	con->backoff = MIN(con->backoff * 2, con_backoff_max);
+}
+
+// The reactor stops watching a socket once it reported it, it is watched again here
+void con_watch(t_connection *con, unsigned int events) {
+	if(con->watched!=events) {
+		reactor_watch(con->sock, con->tag, events);
+		con->watched = events;
+	}
+}
+
+// Moves con along without ever blocking: starts a connect when it is time, notices when
+// one is done and reads whatever arrived into rx. The reactor is told which events to
+// wake us up for, it reports them through con->event.
+void con_poll(t_connection *con, long long now) {
+	struct sockaddr_storage peer;
+	socklen_t len = sizeof(int);
+	unsigned int off;
+	int err = 0;
+	ssize_t n;
+
+	if(__atomic_exchange_n(&con->event, 0, __ATOMIC_ACQ_REL) == con->sock + 1)
+		con->watched = 0; // the reactor stopped watching it
+
+	if(con->state==ConClosed) {
+		if(now < con->retry)
+			return;
+		if(!con_resolve(con) || (con->sock = socket(con->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+			con_fail(con, now);
+			return;
+		}
+		con->state = ConConnecting;
+		con->deadline = now + con_timeout;
+		con->pending = 0;
+		con->head = con->tail = 0;
+		if(connect(con->sock, (struct sockaddr *)&con->addr, con->addrlen) < 0 && errno!=EINPROGRESS) {
+			con_fail(con, now);
+			return;
+		}
+	}
+
+	if(con->state==ConConnecting) {
+		if(getsockopt(con->sock, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) {
+			con_fail(con, now);
+			return;
+		}
+		len = sizeof(peer);
+		if(getpeername(con->sock, (struct sockaddr *)&peer, &len) < 0) { // still under way
+			if(now>=con->deadline)
+				con_fail(con, now);
+			else
+				con_watch(con, EPOLLOUT);
+			return;
+		}
+		con->state = ConReady;
 	}
 
-	while(mp_stat.con.fp && !feof(mp_stat.con.fp)) {
-		if(fscanf(mp_stat.con.fp, "%[^:]: %[^\n]\n", type, value) != 2)
+	while((off = con->head - con->tail) < CON_RING) {
+		n = recv(con->sock, con->rx + con->head % CON_RING, MIN(CON_RING - off, CON_RING - con->head % CON_RING), 0);
+		if(n > 0) {
+			con->head += n;
+		} else if(n==0) { // get_mp tells a clean close from a dropped request
+			con_close(con);
+			return;
+		} else if(errno==EINTR) {
+			continue;
+		} else if(errno==EAGAIN || errno==EWOULDBLOCK) {
 			break;
-		
-		if(strncmp(type, "state", 5)==0) {
+		} else {
+			con_fail(con, now);
+			return;
+		}
+	}
+	con_watch(con, EPOLLIN | EPOLLRDHUP);
+}
+
+// Takes the next complete line out of rx, without the newline. NULL until one is there.
+char *con_line(t_connection *con) {
+	unsigned int i, n;
+
+	for(i=con->tail; i!=con->head && con->rx[i % CON_RING]!='\n'; i++);
+	if(i==con->head) {
+		if(con->head - con->tail == CON_RING) // no newline in sight, it will not fit anyway
+			con->tail = con->head;
+		return NULL;
+	}
+
+	for(n=0; con->tail!=i; con->tail++)
+		if(n < sizeof(con->line) - 1)
+			con->line[n++] = con->rx[con->tail % CON_RING];
+	con->line[n] = '\0';
+	con->tail++;
+
+	return con->line;
+}
+
+// Counts a reply that came in, returns whether it was the last one asked for. Only
+// answers count as success, a peer that accepts and hangs up still backs off.
+char con_replied(t_connection *con) {
+	if(con->pending > 0 && --con->pending)
+		return 0;
+	con->failed = 0;
+	con->backoff = con_backoff_min;
+	return 1;
+}
+
+// Queries are tiny, a send that does not take all of it is a broken connection
+void con_send(t_connection *con, const char *msg, size_t len, int replies) {
+	con->pending += replies;
+	con->deadline = now_ms(CLOCK_MONOTONIC) + con_timeout;
+	if(send(con->sock, msg, len, MSG_NOSIGNAL) != (ssize_t)len)
+		con_close(con);
+}
+
+// "12.345" as 12345, mpd always prints seconds with three decimals
+long long mpd_ms(const char *value) {
+	const char *dot = strchr(value, '.');
+
+	return atoll(value) * 1000 + (dot ? atoi(dot + 1) : 0);
+}
+
+// Keeps one connection parked in idle, mpd answers it only when one of the subsystems
+// changed and only those are queried again. Ticks in between send nothing, get_mp moves
+// the position along from elapsed.
+char mp_parse_mpd() {
+	static const char status[] = "status\n", song[] = "status\ncurrentsong\n", idle[] = "idle player mixer options\n";
+	t_connection *con = &mp_stat.con;
+	char *line, *value, done = 0;
+
+	while((line = con_line(con))) {
+		if(strncmp(line, "OK MPD ", 7)==0) // greeting
+			continue;
+		if(strcmp(line, "OK")==0 || strncmp(line, "ACK ", 4)==0) {
+			if(con_replied(con))
+				done = !mp_stat.idle;
+			mp_stat.idle = 0;
+			continue;
+		}
+		// whole keys only: Artist is followed by ArtistSort, Album by AlbumArtist
+		if(!(value = strstr(line, ": ")))
+			continue;
+		*value = '\0';
+		value += 2;
+
+		if(strcmp(line, "changed")==0) {
+			if(strcmp(value, "player")==0)
+				mp_stat.known &= ~MpdPlayer;
+			else if(strcmp(value, "mixer")==0)
+				mp_stat.known &= ~MpdMixer;
+			else if(strcmp(value, "options")==0)
+				mp_stat.known &= ~MpdOptions;
+		} else if(strcmp(line, "state")==0) {
 			if(strncmp(value, "play", 4)==0)
 				mp_stat.status = 1;
 			else if(strncmp(value, "stop", 4)==0)
 				mp_stat.status = 2;
 			else
 				mp_stat.status = 0;
-		} else if(strncmp(type, "time", 4)==0) {
-			mp_stat.position = atoi(value);
-			dp = strstr(value, ":");
-			dp++;
-			mp_stat.duration = atoi(dp);
-		} else if(strncmp(type, "Artist", 6)==0) {
-			strncpy(mp_stat.artist, value, 128);
-		} else if(strncmp(type, "Album", 5)==0) {
-			strncpy(mp_stat.album, value, 128);
-		} else if(strncmp(type, "Title", 5)==0) {
-			strncpy(mp_stat.title, value, 128);
-		} else if(strncmp(type, "repeat", 6)==0) {
-			if(strncmp(value, "1", 1)==0)
-				mp_stat.repeat = 1;
-			else
-				mp_stat.repeat = 0;
-		} else if(strncmp(type, "random", 6)==0) {
-			if(strncmp(value, "1", 1)==0)
-				mp_stat.shuffle = 1;
-			else
-				mp_stat.shuffle = 0;
-		} else if(strncmp(type, "volume", 6)==0) {
+			mp_stat.elapsed = 0; // stopped has none
+			mp_stat.since = now_ms(CLOCK_MONOTONIC);
+		} else if(strcmp(line, "time")==0) { // mpd before 0.16 has no elapsed
+			mp_stat.elapsed = atoi(value) * 1000LL;
+			if((value = strchr(value, ':')))
+				mp_stat.duration = atoi(value + 1);
+		} else if(strcmp(line, "elapsed")==0) {
+			mp_stat.elapsed = mpd_ms(value);
+		} else if(strcmp(line, "duration")==0) { // mpd 0.20 and later
+			mp_stat.duration = atoi(value);
+		} else if(strcmp(line, "Artist")==0) {
+			snprintf(mp_stat.artist, sizeof(mp_stat.artist), "%s", value);
+		} else if(strcmp(line, "Album")==0) {
+			snprintf(mp_stat.album, sizeof(mp_stat.album), "%s", value);
+		} else if(strcmp(line, "Title")==0) {
+			snprintf(mp_stat.title, sizeof(mp_stat.title), "%s", value);
+		} else if(strcmp(line, "repeat")==0) {
+			mp_stat.repeat = strncmp(value, "1", 1)==0;
+		} else if(strcmp(line, "random")==0) {
+			mp_stat.shuffle = strncmp(value, "1", 1)==0;
+		} else if(strcmp(line, "volume")==0) {
 			mp_stat.volume = atoi(value);
 		}
 	}
 
-	return 1;
+	if(con->state!=ConReady) { // start over on the next connection
+		mp_stat.known = mp_stat.idle = 0;
+	} else if(!con->pending && mp_stat.known!=MpdAll) {
+		// player, mixer and options all live in status, only the player changes the song
+		if(mp_stat.known & MpdPlayer)
+			con_send(con, status, sizeof(status) - 1, 1);
+		else
+			con_send(con, song, sizeof(song) - 1, 2);
+		mp_stat.known = MpdAll;
+	} else if(!con->pending) {
+		con_send(con, idle, sizeof(idle) - 1, 1);
+		con->deadline = LLONG_MAX; // can take hours
+		mp_stat.idle = 1;
+	}
+
+	return done;
 }
 
 char mp_parse_madasul() {
-    static const char cmd[] = "status #c\t##\t#s\t#r\t#n\t$a\t$l\t$t\n";
+	static const char cmd[] = "status #c\t##\t#s\t#r\t#n\t$a\t$l\t$t\n";
+	t_connection *con = &mp_stat.con;
 	unsigned int track, tracknum, atrack;
+	char *line, done = 0;
 
-	mp_stat.duration = mp_stat.position = mp_stat.volume = -1;
+	while((line = con_line(con))) {
+		if(sscanf(line, "%u\t%u\t%i\t%i\t%u\t%127[^\t]\t%127[^\t]\t%127[^\n]", &track, &tracknum, &mp_stat.status, &mp_stat.shuffle, &atrack, mp_stat.artist, mp_stat.album, mp_stat.title)!=8)
+			continue;
 
-    if(send(mp_stat.con.sock, cmd, strlen(cmd), MSG_NOSIGNAL)<0) {
-		mp_stat.con.connected = 0;
-		close(mp_stat.con.sock);
-		fclose(mp_stat.con.fp);
-		return 0;
+		mp_stat.duration = mp_stat.position = mp_stat.volume = -1;
+		mp_stat.status = mp_stat.status==3 ? 1 : (mp_stat.status==1 ? 2 : 0);
+		done = con_replied(con);
 	}
 
-	while(mp_stat.con.fp && !feof(mp_stat.con.fp)) {
-		if(fscanf(mp_stat.con.fp, "%u\t%u\t%i\t%i\t%u\t%128[^\t]\t%128[^\t]\t%128[^\n]\n", &track, &tracknum, &mp_stat.status, &mp_stat.shuffle, &atrack, mp_stat.artist, mp_stat.album, mp_stat.title)!=8)
+	// madasul hangs up after every reply, that is no failure: connect again next tick
+	if(con->state==ConReady && !con->pending && !done)
+		con_send(con, cmd, sizeof(cmd) - 1, 1);
+
+	return done;
+}
+#endif
+
+// Values templates can use. Lists are iterated with {#name}, inside the block the
+// other values of that sensor refer to the current item.
+static long tv_time(int i) { return datetime_stat.time; }
+static int tv_cpus() { return cpu_stat.num_groups; }
+static long tv_cpu_load(int i) { return MIN(cpu_agg_value(&cpu_stat.load[i]), 100); }
+static long tv_cpu_total(int i) { return MIN(cpu_stat.perc[cpu_stat.num_cols], 100); }
+static long tv_clock_mhz(int i) { return cpu_agg_value(&clock_stat.agg[i]) / 1000; }
+static long tv_clock_perc(int i) { return cpu_agg_value(&clock_stat.perc_agg[i]); }
+static long tv_mem_free(int i) { return mem_stat.info[MemTotal] ? mem_stat.info[MemAvailable] * 100 / mem_stat.info[MemTotal] : 0; }
+static long tv_mem_used(int i) { return 100 - tv_mem_free(i); }
+static long tv_mem_swap(int i) { return percent(mem_stat.info[MemSwapTotal] - mem_stat.info[MemSwapFree], mem_stat.info[MemSwapTotal]); }
+static long tv_mem_swapin(int i) { return mem_stat.swapin.rate; }
+static long tv_mem_swapout(int i) { return mem_stat.swapout.rate; }
+static long tv_mem_faults(int i) { return mem_stat.faults.rate; }
+static long tv_mem_majfaults(int i) { return mem_stat.majfaults.rate; }
+static int tv_therms() { return therm_stat.num_therms; }
+static long tv_therm_ok(int i) { return therm_stat.therms[i]->ok; }
+static long tv_therm_temp(int i) { return therm_stat.therms[i]->temp / 1000; }
+static long tv_therm_warn(int i) { return therm_stat.therms[i]->temp>=therm_stat.therms[i]->warn; }
+static long tv_therm_perc(int i) { // from 40° to the warning temperature
+	t_therm *therm = therm_stat.therms[i];
+	return therm->temp<=40000 || therm->warn<=40000 ? 0 : MIN((therm->temp - 40000) * 100LL / (therm->warn - 40000), 100);
+}
+static const char *tv_therm_name(int i) { return therm_stat.therms[i]->name; }
+static int tv_ifaces() { return net_stat.count; }
+static long tv_net_shown(int i) { t_iface *f = &net_stat.ifaces[i]; return f->used && strncmp(f->name, "lo", 3); }
+static long tv_net_num(int i) { // interfaces that are shown
+	long n = 0;
+	for(i=0; i<net_stat.count; i++)
+		n += tv_net_shown(i);
+	return n;
+}
+static long tv_net_type(int i) { // by name: 1 wireless, 2 ethernet, 3 tunnel, 4 usb, 5 ppp, 0 other
+	const char *n = net_stat.ifaces[i].name;
+	return !strncmp(n, "wl", 2) ? 1 : n[0]=='e' ? 2 : !strncmp(n, "tun", 3) || !strncmp(n, "tap", 3) || !strncmp(n, "wg", 2) ? 3 :
+		!strncmp(n, "usb", 3) ? 4 : !strncmp(n, "ppp", 3) ? 5 : 0;
+}
+static long tv_net_up(int i) { return net_stat.ifaces[i].up; }
+static long tv_net_idle(int i) { return net_stat.ifaces[i].idle; }
+static long tv_net_rx(int i) { return net_stat.ifaces[i].rxr.rate; }
+static long tv_net_tx(int i) { return net_stat.ifaces[i].txr.rate; }
+static const char *tv_net_name(int i) { return net_stat.ifaces[i].name; }
+static const char *tv_wifi_name(int i) { return wifi_stat.devname; }
+static long tv_wifi_perc(int i) { return wifi_stat.perc; }
+static int tv_bats() { return battery_stats.num_bats; }
+static long tv_bat_ac(int i) { // a battery that reports neither a state nor a rate counts as full
+	for(i=0; i<battery_stats.num_bats; i++)
+		if(battery_stats.state[i]!=BatCharged && (battery_stats.state[i]!=BatUnknown || battery_stats.rate[i]))
+			return 0;
+	return 1;
+}
+static long tv_bat_charging(int i) { return battery_stats.state[i]==BatCharging; }
+static long tv_bat_discharging(int i) { return battery_stats.state[i]==BatDischarging; }
+static long tv_bat_perc(int i) { return battery_stats.capacity[i] ? MIN(100 * battery_stats.remaining[i] / battery_stats.capacity[i], 100) : 0; }
+static long tv_bat_minutes(int i) { // until full or empty, of all batteries
+	long m = 0;
+	for(i=0; i<battery_stats.num_bats; i++)
+		if(battery_stats.state[i]==BatCharging && battery_stats.rate[i])
+			m += (battery_stats.capacity[i] - battery_stats.remaining[i]) * 60 / battery_stats.rate[i];
+		else if(battery_stats.state[i]==BatDischarging && battery_stats.total_rate.rate>=1)
+			m += battery_stats.remaining[i] * 60 / (long long)battery_stats.total_rate.rate;
+	return m;
+}
+static int tv_brghts() { return brightness_stat.num_brght; }
+static long tv_brght_perc(int i) { return brightness_stat.max_brghts[i] ? brightness_stat.brghts[i] * 100 / brightness_stat.max_brghts[i] : 0; }
+static long tv_sys_load(int i) { return sysinfo_stat.load[0]; }
+static long tv_sys_cpuload(int i) { return sysinfo_stat.load[0] / (cpu_stat.num_cpus ? cpu_stat.num_cpus : 1); }
+static long tv_sys_uptime(int i) { return sysinfo_stat.uptime / 60; }
+static long tv_sys_free(int i) { return sysinfo_stat.ram_total ? sysinfo_stat.ram_free * 100 / sysinfo_stat.ram_total : 0; }
+static const char *tv_delim(int i) { return delimiter; }
+#ifdef USE_SOCKETS
+static long tv_mp_status(int i) { return mp_stat.status; }
+static long tv_mp_playing(int i) { return mp_stat.status==1; }
+static long tv_mp_position(int i) { return mp_stat.position; }
+static long tv_mp_duration(int i) { return mp_stat.duration; }
+static long tv_mp_perc(int i) { return mp_stat.duration>0 ? MIN(mp_stat.position * 100 / mp_stat.duration, 100) : 0; }
+static long tv_mp_repeat(int i) { return mp_stat.repeat; }
+static long tv_mp_shuffle(int i) { return mp_stat.shuffle; }
+static long tv_mp_volume(int i) { return mp_stat.volume; }
+static const char *tv_mp_artist(int i) { return mp_stat.artist; }
+static const char *tv_mp_title(int i) { return mp_stat.title; }
+#endif
+#ifdef USE_ALSAVOL
+static long tv_vol_perc(int i) {
+	long tvol = alsavol_stat.vol_max - alsavol_stat.vol_min;
+	return tvol ? (alsavol_stat.vol - alsavol_stat.vol_min) * 100 / tvol : 0;
+}
+#endif
+#ifdef USE_NOTIFY
+static long tv_notify_remaining(int i) { return MAX(notify_stat.message->started_at + notify_stat.message->expires_after - time(NULL), 0); }
+static const char *tv_notify_app(int i) { return notify_stat.message->appname; }
+static const char *tv_notify_summary(int i) { return notify_stat.message->summary; }
+static const char *tv_notify_body(int i) { // marquee_chars of it, scrolled by marquee_offset every second
+	static char shown[sizeof(notify_stat.message->body)];
+	const char *body = notify_stat.message->body;
+	int len = strlen(body);
+	long offset = ((time(NULL) - notify_stat.message->started_at) - 1) * marquee_offset;
+
+	body += MAX(MIN(offset, len - marquee_chars), 0);
+	len = MIN(strlen(body), (size_t)marquee_chars);
+	memcpy(shown, body, len);
+	shown[len] = '\0';
+	return shown;
+}
+#endif
+
+static const t_tplvar tpl_vars[] = {
+	{ "time", tv_time },
+	{ "cpu", NULL, NULL, tv_cpus },
+	{ "cpu.load", tv_cpu_load },
+	{ "cpu.total", tv_cpu_total },
+	{ "clock", NULL, NULL, tv_cpus },
+	{ "clock.mhz", tv_clock_mhz },
+	{ "clock.perc", tv_clock_perc },
+	{ "mem.free", tv_mem_free },
+	{ "mem.used", tv_mem_used },
+	{ "mem.swap", tv_mem_swap },
+	{ "mem.swapin", tv_mem_swapin },
+	{ "mem.swapout", tv_mem_swapout },
+	{ "mem.faults", tv_mem_faults },
+	{ "mem.majfaults", tv_mem_majfaults },
+	{ "therm", NULL, NULL, tv_therms },
+	{ "therm.ok", tv_therm_ok },
+	{ "therm.temp", tv_therm_temp },
+	{ "therm.warn", tv_therm_warn },
+	{ "therm.perc", tv_therm_perc },
+	{ "therm.name", NULL, tv_therm_name },
+	{ "net", NULL, NULL, tv_ifaces },
+	{ "net.num", tv_net_num },
+	{ "net.shown", tv_net_shown },
+	{ "net.type", tv_net_type },
+	{ "net.up", tv_net_up },
+	{ "net.idle", tv_net_idle },
+	{ "net.rx", tv_net_rx },
+	{ "net.tx", tv_net_tx },
+	{ "net.name", NULL, tv_net_name },
+	{ "wifi.name", NULL, tv_wifi_name },
+	{ "wifi.perc", tv_wifi_perc },
+	{ "bat", NULL, NULL, tv_bats },
+	{ "bat.ac", tv_bat_ac },
+	{ "bat.charging", tv_bat_charging },
+	{ "bat.discharging", tv_bat_discharging },
+	{ "bat.perc", tv_bat_perc },
+	{ "bat.minutes", tv_bat_minutes },
+	{ "brightness", NULL, NULL, tv_brghts },
+	{ "brightness.perc", tv_brght_perc },
+	{ "sys.load", tv_sys_load },
+	{ "sys.cpuload", tv_sys_cpuload },
+	{ "sys.uptime", tv_sys_uptime },
+	{ "sys.free", tv_sys_free },
+	{ "delim", NULL, tv_delim },
+#ifdef USE_SOCKETS
+	{ "mp.status", tv_mp_status },
+	{ "mp.playing", tv_mp_playing },
+	{ "mp.position", tv_mp_position },
+	{ "mp.duration", tv_mp_duration },
+	{ "mp.perc", tv_mp_perc },
+	{ "mp.repeat", tv_mp_repeat },
+	{ "mp.shuffle", tv_mp_shuffle },
+	{ "mp.volume", tv_mp_volume },
+	{ "mp.artist", NULL, tv_mp_artist },
+	{ "mp.title", NULL, tv_mp_title },
+#endif
+#ifdef USE_ALSAVOL
+	{ "vol.perc", tv_vol_perc },
+#endif
+#ifdef USE_NOTIFY
+	{ "notify.remaining", tv_notify_remaining },
+	{ "notify.app", NULL, tv_notify_app },
+	{ "notify.summary", NULL, tv_notify_summary },
+	{ "notify.body", NULL, tv_notify_body },
+#endif
+};
+
+// Compiles "text {name:mods} text" into ops. Mods, separated by spaces, are *N (multiply),
+// /N (divide), %N (modulo), maxN (cap), 0N (zero pad to N digits), .N (cut text to N
+// chars), barN (0-100 to 0-N), scaled (bytes with units), color=rgb..rgb (colour of a 0-100
+// value) and a strftime format starting with % that takes the rest. {?name} and {!name}
+// start a block shown if the value is (not) zero or empty, {?name<N}, {?name>N} and
+// {?name=N} compare a number instead. {#list:separator} repeats a block for every item,
+// {/} ends a block, {{ is a {.
+void tpl_compile(t_template *tpl) {
+	const char *p = tpl->src, *q, *m, *e;
+	int i, n = 1, depth = 0, open[8];
+	t_tplop *op;
+
+	for(q=p; *q; q++)
+		n += *q=='{' ? 2 : 0;
+	XALLOC(tpl->ops, t_tplop, n);
+
+	for(op=tpl->ops; *p; op++) {
+		if(*p!='{' || p[1]=='{') {
+			op->op = TplLit;
+			op->s = p;
+			for(q=p+1; *q && *q!='{'; q++);
+			op->len = q - p;
+			p = *p=='{' ? p + 2 : q;
+			continue;
+		}
+		if((e = strchr(p, '}')) == NULL)
+			die("template: missing } in \"%s\"\n", tpl->src);
+		if(p[1]=='/') {
+			if(depth==0)
+				die("template: {/} without a block in \"%s\"\n", tpl->src);
+			op->op = TplEnd;
+			i = open[--depth];
+			tpl->ops[i].next = op - tpl->ops - i + 1;
+			p = e + 1;
 			continue;
+		}
+		op->op = p[1]=='?' ? TplIf : p[1]=='!' ? TplIfNot : p[1]=='#' ? TplLoop : TplNum;
+		p += op->op==TplNum ? 1 : 2;
+		for(m=p; m<e && *m!=':' && *m!='<' && *m!='>' && *m!='='; m++);
+		for(i=0; i<LENGTH(tpl_vars) && (strncmp(tpl_vars[i].name, p, m - p) || tpl_vars[i].name[m - p]); i++);
+		if(i==LENGTH(tpl_vars) || (op->op==TplLoop)!=(tpl_vars[i].count!=NULL))
+			die("template: unknown %s %.*s\n", op->op==TplLoop ? "list" : "value", (int)(m - p), p);
+		op->var = &tpl_vars[i];
+		if(op->op==TplNum && op->var->str)
+			op->op = TplStr;
+		if(m<e && *m!=':') {
+			if((op->op!=TplIf && op->op!=TplIfNot) || op->var->str)
+				die("template: only numbers can be compared in \"%s\"\n", tpl->src);
+			op->cmp = *m;
+			op->arg = atol(m + 1);
+		}
 
-		mp_stat.status = mp_stat.status==3 ? 1 : (mp_stat.status==1 ? 2 : 0);		
+		if(op->op==TplIf || op->op==TplIfNot || op->op==TplLoop) {
+			if(depth==LENGTH(open))
+				die("template: blocks nested too deep in \"%s\"\n", tpl->src);
+			open[depth++] = op - tpl->ops;
+			if(op->op==TplLoop && m<e)
+				op->s = strndup(m + 1, e - m - 1);
+			p = e + 1;
+			continue;
+		}
+
+		for(p=m; p<e; p=q) {
+			p += *p==':' || *p==' ';
+			for(q=p; q<e && *q!=' '; q++);
+			if(*p=='%' && (p[1]<'0' || p[1]>'9')) {
+				op->op = TplTime;
+				op->s = strndup(p, e - p);
+				q = e;
+			} else if(*p=='*')
+				op->mul = atoi(p + 1);
+			else if(*p=='/')
+				op->div = atoi(p + 1);
+			else if(*p=='%')
+				op->mod = atoi(p + 1);
+			else if(*p=='.')
+				op->len = atoi(p + 1);
+			else if(*p=='0')
+				op->width = atoi(p);
+			else if(!strncmp(p, "max", 3))
+				op->max = atoi(p + 3);
+			else if(!strncmp(p, "bar", 3))
+				op->bar = atoi(p + 3);
+			else if(!strncmp(p, "scaled", 6) && q - p == 6)
+				op->scaled = 1;
+			else if(!strncmp(p, "color=", 6) && q - p == 14 && p[9]=='.' && p[10]=='.')
+				op->grad = gradient_table(p + 6, p + 11);
+			else if(q>p)
+				die("template: unknown modifier %.*s\n", (int)(q - p), p);
+		}
+		p = e + 1;
 	}
+	if(depth)
+		die("template: missing {/} in \"%s\"\n", tpl->src);
+	tpl->num_ops = op - tpl->ops;
+}
 
-	mp_stat.con.connected = 0;
-	close(mp_stat.con.sock);
-	fclose(mp_stat.con.fp);
+void tpl_run(t_status *st, const t_tplop *op, const t_tplop *end, int i) {
+	const char *s;
+	size_t len;
+	long v;
+	time_t t;
+	int j, n, shown;
+
+	while(op<end) {
+		switch(op->op) {
+		case TplLit:
+			aputn(st, op->s, op->len);
+			break;
+		case TplStr:
+			s = op->var->str(i);
+			len = strlen(s);
+			aputn(st, s, op->len && op->len<len ? op->len : len);
+			break;
+		case TplTime:
+			t = op->var->num(i);
+			astrftime(st, op->s, localtime(&t));
+			break;
+		case TplNum:
+			v = op->var->num(i);
+			if(op->mul)
+				v *= op->mul;
+			if(op->div)
+				v /= op->div;
+			if(op->mod)
+				v %= op->mod;
+			if(op->max && v>op->max)
+				v = op->max;
+			if(op->grad)
+				aputn(st, op->grad[v<0 ? 0 : v>100 ? 100 : v], 3);
+			else if(op->scaled)
+				aputscaled(st, v<0 ? 0 : v);
+			else {
+				if(op->bar)
+					v = (v<0 ? 0 : v>100 ? 100 : v) * op->bar / 100;
+				if(v<0)
+					aputn(st, "-", 1);
+				aputu(st, v<0 ? -(unsigned long)v : v, op->width);
+			}
+			break;
+		case TplIf:
+		case TplIfNot:
+			if(op->cmp) {
+				v = op->var->num(i);
+				v = op->cmp=='<' ? v<op->arg : op->cmp=='>' ? v>op->arg : v==op->arg;
+			} else
+				v = op->var->num ? op->var->num(i)!=0 : op->var->str(i)[0]!=0;
+			if(v != (op->op==TplIf)) {
+				op += op->next;
+				continue;
+			}
+			break;
+		case TplLoop:
+			// the separator only goes between items that showed something
+			for(j=0, shown=0, n=op->var->count(); j<n; j++) {
+				len = st->len;
+				if(shown && op->s)
+					aputs(st, op->s);
+				v = st->len;
+				tpl_run(st, op + 1, op + op->next - 1, j);
+				if(st->len==v && !st->truncated) {
+					st->len = len;
+					st->buf[len] = 0;
+				} else
+					shown++;
+			}
+			op += op->next;
+			continue;
+		}
+		op++;
+	}
+}
+
+void tpl_render(t_status *st, t_template *tpl) {
+	if(tpl->ops==NULL)
+		tpl_compile(tpl);
+	tpl_run(st, tpl->ops, tpl->ops + tpl->num_ops, 0);
+}
+
+// Bookkeeping after a sensor was read, returns whether the status has to be spliced again
+char segment_done(int func, char ok) {
+	char dirty = ok!=segment_ok[func] || (ok && segments[func]->dirty);
+
+#ifndef NO_VIEWS
+	view_update(func, ok);
+#endif
+	segments[func]->dirty = 0;
+	segment_ok[func] = ok;
+
+	return dirty;
+}
+
+#ifdef USE_THREADS
+void collector_start(int func) {
+	t_collector *c;
+
+	if(!offloadable[func])
+		die("statinator4k: sensor %d cannot be read on a thread\n", func);
+	XALLOC(c, t_collector, 1);
+	c->func = func;
+	c->back = status_new(max_status_length);
+	if((c->wake = eventfd(0, EFD_CLOEXEC)) < 0 || pthread_create(&c->thread, NULL, collector_run, c) != 0)
+		die("statinator4k: cannot start collector thread\n");
+	collectors[func] = c;
+}
+
+// Reads and formats into the back buffer whenever main asks, then publishes the reading.
+// Main does not touch the back buffer or the sensor's stat until it collected it.
+void *collector_run(void *arg) {
+	t_collector *c = arg;
+	unsigned long long n = 1;
+	sigset_t sigs;
+
+	sigfillset(&sigs);
+	pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+	while(read(c->wake, &n, sizeof(n)) == sizeof(n)) {
+		if(__atomic_exchange_n(&c->refresh, 0, __ATOMIC_ACQ_REL))
+			c->back->valid = 0;
+		c->ok = statusfuncs[c->func](c->back);
+		__atomic_store_n(&c->done, c->done + 1, __ATOMIC_RELEASE);
+		n = 1;
+		if(write(collect_fd, &n, sizeof(n)) < 0)
+			break;
+	}
+	return NULL;
+}
+
+// A sensor that is still busy is not asked again, its segment just stays as it was
+void collector_kick(t_collector *c, long long now) {
+	unsigned long long n = 1;
+
+	if(c->busy)
+		return;
+	c->busy = write(c->wake, &n, sizeof(n)) == sizeof(n);
+	c->kicked = now;
+}
+
+// An inline read can not be interrupted, but a sensor that takes longer than its budget
+// budget_strikes times in a row is moved to a thread, so it can not delay the others again
+void budget_check(int func, long long took) {
+	int budget = sensor_budgets[func] > 0 ? sensor_budgets[func] : sensor_budget;
+
+	if(took<=budget) {
+		slow_reads[func] = 0;
+		return;
+	}
+	if(!offloadable[func]) // main shares its stat, it has to stay slow
+		return;
+	if(++slow_reads[func] >= budget_strikes) {
+		fprintf(stderr, "statinator4k: sensor %d took %lldms, reading it on a thread from now on\n", func, took);
+		collector_start(func);
+	}
+}
+
+// Takes over a published reading, the back buffer is only copied if it was formatted again
+char collector_harvest(t_collector *c) {
+	t_status *seg = segments[c->func];
+
+	if(!c->busy || __atomic_load_n(&c->done, __ATOMIC_ACQUIRE) == c->seen)
+		return 0;
+	c->seen++;
+	c->busy = 0;
+
+	if(c->back->dirty) {
+		memcpy(seg->buf, c->back->buf, c->back->len + 1);
+		seg->len = c->back->len;
+		seg->truncated = c->back->truncated;
+		seg->fp = c->back->fp;
+		seg->valid = c->back->valid;
+		seg->dirty = 1;
+		c->back->dirty = 0;
+	}
 
 	return 1;
 }
+#endif
+
+#ifndef NO_VIEWS
+// Renders the segment of a sensor that was just read in every view. The fingerprint of
+// the main segment tells whether the readings changed, views never read anything.
+void view_update(int func, char ok) {
+	int i;
+	t_view *view;
+	t_status *seg;
+
+	for(i=0; i<LENGTH(views); i++) {
+		view = &views[i];
+		if(view->templates[func].src==NULL)
+			continue;
+		if((seg = view->segments[func]) == NULL)
+			seg = view->segments[func] = status_new(max_status_length);
+
+		if(!ok) {
+			view->dirty |= seg->len!=0;
+			status_reset(seg);
+			seg->valid = 0;
+		} else if(!seg->valid || segments[func]->dirty) {
+			status_reset(seg);
+			tpl_render(seg, &view->templates[func]);
+			seg->valid = 1;
+			view->dirty = 1;
+		}
+	}
+}
+
+// Splices the segments in sensor order and replaces the sink, so readers never see half of it
+void view_write(t_view *view) {
+	char tmp[PATH_MAX];
+	int f, fd;
+	ssize_t n = 0;
 
+	view->dirty = 0;
+	snprintf(tmp, sizeof(tmp), "%s.tmp", view->sink);
+	if((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+		return;
+	for(f=0; f<NUMFUNCS && n>=0; f++)
+		if(view->segments[f]!=NULL && view->segments[f]->len)
+			n = write(fd, view->segments[f]->buf, view->segments[f]->len);
+	if(n>=0)
+		n = write(fd, "\n", 1);
+	close(fd);
+	if(n<0 || rename(tmp, view->sink)!=0)
+		unlink(tmp);
+}
+#endif
 
-int read_clock(int num, char type[3], unsigned int *target) {
+// First line of a small (sysfs) file without the newline
+int read_line(char *buf, int size, const char *fmt, ...) {
 	static char filename[BUF_SIZE];
+	va_list ap;
 	FILE *fp;
 
-	snprintf(filename, BUF_SIZE, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_%s_freq", num, type);
+	va_start(ap, fmt);
+	vsnprintf(filename, BUF_SIZE, fmt, ap);
+	va_end(ap);
+
+	if((fp = fopen(filename, "r"))==NULL)
+		return 0;
+	if(fgets(buf, size, fp)==NULL) {
+		fclose(fp);
+		return 0;
+	}
+	fclose(fp);
+	buf[strcspn(buf, "\n")] = 0;
+
+	return 1;
+}
+
+int read_policy(const char *policy, const char *name, unsigned int *target) {
+	static char filename[BUF_SIZE];
+	FILE *fp;
+
+	snprintf(filename, BUF_SIZE, "/sys/devices/system/cpu/cpufreq/%s/%s", policy, name);
 	fp = fopen(filename, "r");
 	if(fp==NULL)
 		return 0;
@@ -950,6 +2962,297 @@ int read_clock(int num, char type[3], unsigned int *target) {
 	return 1;
 }
 
+// Per second rate of a counter that is bits wide and may wrap. Rates are measured on
+// the monotonic clock, so they stay right however long a tick took. tau > 0 smoothes
+// them with an EWMA of that many seconds.
+double rate_counter(t_rate *r, unsigned long long value, int bits, int tau) {
+	long long now = now_ms(CLOCK_MONOTONIC);
+	unsigned long long delta = value - r->last;
+
+	if(bits < 64)
+		delta &= (1ULL << bits) - 1;
+	// a 64 bit counter running backwards was reset (device re-created), no rate this time
+	if(r->ts && now > r->ts && (bits < 64 || value >= r->last))
+		rate_smooth(r, delta * 1000.0 / (now - r->ts), (now - r->ts) / 1000.0, tau);
+
+	r->last = value;
+	r->ts = now;
+	return r->rate;
+}
+
+// EWMA of a value that is a rate already (like a batteries power_now)
+double rate_gauge(t_rate *r, double value, int tau) {
+	long long now = now_ms(CLOCK_MONOTONIC);
+
+	rate_smooth(r, value, r->ts ? (now - r->ts) / 1000.0 : 0, tau);
+	r->ts = now;
+	return r->rate;
+}
+
+void rate_smooth(t_rate *r, double sample, double dt, int tau) {
+	if(tau > 0 && r->samples++ > 0)
+		r->rate += (sample - r->rate) * dt / (tau + dt);
+	else
+		r->rate = sample;
+}
+
+// Open a file for src_read, size is a first guess of its length
+char src_open(t_source *src, int owner, size_t size, const char *fmt, ...) {
+	va_list ap;
+	char path[BUF_SIZE];
+
+	va_start(ap, fmt);
+	vsnprintf(path, BUF_SIZE, fmt, ap);
+	va_end(ap);
+
+	XALLOC(src->path, char, strlen(path) + 1);
+	strcpy(src->path, path);
+	XALLOC(src->buf, char, size);
+	src->size = size;
+	src->owner = owner;
+	src->fd = open(src->path, O_RDONLY | O_CLOEXEC);
+#ifdef USE_URING
+	if((sources = realloc(sources, sizeof(t_source*) * (num_sources + 1))) == NULL)
+		die("fatal: could not realloc() %u bytes (sources)\n", sizeof(t_source*) * (num_sources + 1));
+	sources[num_sources++] = src;
+#endif
+
+	return src->fd >= 0;
+}
+
+// Read the whole file with one pread (more only while the buffer grows). The returned
+// buffer is 0-terminated and valid until the next read of src. A file that vanished
+// (unplugged device, reloaded driver) is reopened transparently.
+char *src_read(t_source *src) {
+	ssize_t n;
+	int retry = 1;
+
+#ifdef USE_URING
+	if(src->prefetched) { // already read by uring_prefetch this tick
+		src->prefetched = 0;
+		if(src->res >= 0 && src->res < src->size - 1) {
+			src->buf[src->res] = 0;
+			src->len = src->res;
+			return src->buf;
+		}
+	}
+#endif
+
+	while(1) {
+		if(src->fd < 0 && (src->fd = open(src->path, O_RDONLY | O_CLOEXEC)) < 0)
+			return NULL;
+
+		while((n = pread(src->fd, src->buf, src->size - 1, 0)) == src->size - 1) {
+			src->size *= 2;
+			if((src->buf = realloc(src->buf, src->size)) == NULL)
+				die("fatal: could not realloc() %u bytes (src)\n", src->size);
+		}
+		if(n >= 0)
+			break;
+
+		if(errno!=ENODEV && errno!=ESTALE && errno!=EBADF)
+			return NULL;
+		close(src->fd);
+		src->fd = -1;
+		if(!retry--)
+			return NULL;
+	}
+	src->buf[n] = 0;
+	src->len = n;
+
+	return src->buf;
+}
+
+void src_close(t_source *src) {
+#ifdef USE_URING
+	int i;
+
+	for(i=0; i<num_sources; i++)
+		if(sources[i]==src)
+			sources[i] = sources[--num_sources];
+#endif
+	if(src->fd >= 0)
+		close(src->fd);
+	free(src->path);
+	free(src->buf);
+	memset(src, 0, sizeof(t_source));
+	src->fd = -1;
+}
+
+#ifdef USE_URING
+// Set up the rings without liburing. Returns 0 (and src_read keeps using pread) when the
+// kernel has no io_uring or it is forbidden.
+char uring_init() {
+	struct io_uring_params p;
+	size_t sqlen, cqlen;
+	char *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	if((uring.fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p)) < 0)
+		return 0;
+
+	sqlen = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cqlen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP)
+		sqlen = cqlen = MAX(sqlen, cqlen);
+
+	sq = mmap(NULL, sqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQ_RING);
+	cq = p.features & IORING_FEAT_SINGLE_MMAP ? sq : mmap(NULL, cqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_CQ_RING);
+	uring.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQES);
+	if(sq==MAP_FAILED || cq==MAP_FAILED || uring.sqes==MAP_FAILED) {
+		close(uring.fd);
+		uring.fd = -1;
+		return 0;
+	}
+
+	uring.entries = p.sq_entries;
+	uring.sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+	uring.sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+	uring.sq_array = (unsigned int *)(sq + p.sq_off.array);
+	uring.cq_head = (unsigned int *)(cq + p.cq_off.head);
+	uring.cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+	uring.cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+	uring.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	return 1;
+}
+
+// Read every source of the due sensors with one io_uring_enter (per URING_ENTRIES files)
+// and leave the results for src_read. Reads that fail or do not fit are redone by
+// src_read with a plain pread.
+void uring_prefetch(const char *due) {
+	unsigned int start, tail, head, n, i = 0;
+	int submitted;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	t_source *src;
+
+	while(uring.fd >= 0 && i < num_sources) {
+		start = tail = *uring.sq_tail;
+		for(n = 0; i < num_sources && n < uring.entries; i++) {
+			src = sources[i];
+			if(!due[src->owner] || src->fd < 0)
+				continue;
+			sqe = &uring.sqes[tail & *uring.sq_mask];
+			memset(sqe, 0, sizeof(struct io_uring_sqe));
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = src->fd;
+			sqe->addr = (unsigned long)src->buf;
+			sqe->len = src->size - 1;
+			sqe->user_data = i;
+			uring.sq_array[tail & *uring.sq_mask] = tail & *uring.sq_mask;
+			tail++;
+			n++;
+		}
+		if(n==0)
+			break;
+		__atomic_store_n(uring.sq_tail, tail, __ATOMIC_RELEASE);
+
+		if((submitted = syscall(__NR_io_uring_enter, uring.fd, n, n, IORING_ENTER_GETEVENTS, NULL, 0)) < 0) {
+			if(errno!=EINTR && errno!=EAGAIN && errno!=EBUSY) {
+				close(uring.fd); // broken ring, back to pread for good
+				uring.fd = -1;
+				return;
+			}
+			submitted = 0;
+		}
+		if(submitted < n) {
+			// the kernel takes entries in order and left the rest in the ring, take them
+			// back so they are not submitted with the next batch. src_read preads those.
+			__atomic_store_n(uring.sq_tail, start + submitted, __ATOMIC_RELEASE);
+			n = submitted;
+		}
+
+		head = *uring.cq_head;
+		while(n > 0) {
+			tail = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+			if(head==tail) { // interrupted before everything completed
+				syscall(__NR_io_uring_enter, uring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+				continue;
+			}
+			for(; head != tail && n > 0; head++, n--) {
+				cqe = &uring.cqes[head & *uring.cq_mask];
+				src = sources[cqe->user_data];
+				src->res = cqe->res;
+				src->prefetched = 1;
+			}
+			__atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+		}
+	}
+}
+#endif
+
+long long now_ms(clockid_t clk) {
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Next deadline of func. It is aligned to a wall clock multiple of the sensors interval,
+// so a 60s datetime is refreshed on the full minute.
+long long sched_next(int func, long long now) {
+	long long interval = (sensor_intervals[func] > 0 ? sensor_intervals[func] : refresh_wait) * 1000LL;
+
+	return now + interval - now_ms(CLOCK_REALTIME) % interval;
+}
+
+void sched_push(int func, long long due) {
+	int i = sched_len++, p;
+
+	for(; i>0 && sched_heap[p = (i - 1) / 2].due > due; i = p)
+		sched_heap[i] = sched_heap[p];
+	sched_heap[i].due = due;
+	sched_heap[i].func = func;
+}
+
+t_deadline sched_pop() {
+	t_deadline top = sched_heap[0], last = sched_heap[--sched_len];
+	int i = 0, c;
+
+	while((c = 2 * i + 1) < sched_len) {
+		if(c + 1 < sched_len && sched_heap[c + 1].due < sched_heap[c].due)
+			c++;
+		if(last.due <= sched_heap[c].due)
+			break;
+		sched_heap[i] = sched_heap[c];
+		i = c;
+	}
+	sched_heap[i] = last;
+	return top;
+}
+
+// Make func due immediately (and put it back on the heap if it has a segment)
+void sched_now(int func) {
+	int i, p;
+	t_deadline d;
+
+	for(i=0; i<sched_len && sched_heap[i].func!=func; i++);
+	if(i==sched_len) {
+		if(segments[func]!=NULL)
+			sched_push(func, 0);
+		return;
+	}
+
+	d = sched_heap[i];
+	d.due = 0;
+	for(; i>0; i = p) {
+		p = (i - 1) / 2;
+		sched_heap[i] = sched_heap[p];
+	}
+	sched_heap[0] = d;
+}
+
+// Wake up the main loop when fd gets ready. Closed fds leave the epoll set on their own.
+void reactor_watch(int fd, int tag, unsigned int events) {
+	struct epoll_event ev;
+
+	ev.events = events;
+	ev.data.u64 = ((unsigned long long)tag << 32) | (unsigned int)fd;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0 && errno==EEXIST)
+		epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
 void die(const char *errstr, ...) {
 	va_list ap;
 
@@ -961,8 +3264,26 @@ void die(const char *errstr, ...) {
 
 
 int main(int argc, char **argv) {
-	char stext[max_status_length], ostext[max_status_length];
-	int mc =0, i = 0;
+	char sbuf[max_status_length], ostext[max_status_length];
+	t_status stext = { sbuf, 0, sizeof(sbuf), 0 };
+#ifdef USE_URING
+	char due[NUMFUNCS];
+#endif
+	int mc =0, i = 0, f, n, running = 1, timer_fd, signal_fd;
+#ifndef NO_VIEWS
+	int v;
+#endif
+	char ok, dirty, harvest = 0;
+	long long now;
+#ifdef USE_THREADS
+	long long started;
+#endif
+	unsigned long long expirations;
+	struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+	struct epoll_event events[8];
+	struct signalfd_siginfo si;
+	sigset_t sigs;
+	t_deadline d;
 #ifdef USE_X11
 	Display *dpy;
 	Window root;
@@ -982,7 +3303,12 @@ int main(int argc, char **argv) {
 #ifdef USE_SOCKETS
 	check_mp();
 #endif
-	net_stat.count = 0;
+#ifdef USE_URING
+	uring_init();
+#endif
+	check_mem();
+	src_open(&wifi_stat.src, WIFI, BUF_SIZE, "/proc/net/wireless");
+	check_net();
 
 #ifdef USE_NOTIFY
 	if(!notify_init(0)) {
@@ -991,41 +3317,229 @@ int main(int argc, char **argv) {
 	}
 #endif
 
-	while ( 1 )
+	// the main loop blocks in epoll_wait only: sensor deadlines come from a timerfd,
+	// signals from a signalfd, notifications and players from their sockets
+	sigemptyset(&sigs);
+	sigaddset(&sigs, SIGHUP);
+	sigaddset(&sigs, SIGINT);
+	sigaddset(&sigs, SIGTERM);
+	sigprocmask(SIG_BLOCK, &sigs, NULL);
+	if((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+			(timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0 ||
+			(signal_fd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+		die("statinator4k: cannot create event loop\n");
+	reactor_watch(timer_fd, EvTimer, EPOLLIN);
+	reactor_watch(signal_fd, EvSignal, EPOLLIN);
 #ifdef USE_NOTIFY
-		if( !notify_check() )
+	if((n = notify_fd()) >= 0)
+		reactor_watch(n, EvNotify, EPOLLIN);
 #endif
-		{
-			stext[0] = 0;
-			aprintf(stext, " ");
-			mc = 0;
-
+	if((n = check_uevent()) >= 0)
+		reactor_watch(n, EvUevent, EPOLLIN);
+	if(net_stat.nl_events >= 0)
+		reactor_watch(net_stat.nl_events, EvRtnl, EPOLLIN);
+
+	// every sensor that is shown gets a segment and is due right away
+	now = now_ms(CLOCK_MONOTONIC);
+	for(i=0; i<LENGTH(status_funcs_order); i++)
+		if(segments[f = status_funcs_order[i]]==NULL) {
+			segments[f] = status_new(max_status_length);
+			sched_push(f, now);
+		}
 #ifndef NO_MSG_FUNCS
-			for(i=0; i<LENGTH(message_funcs_order); i++)
-				if(statusfuncs[message_funcs_order[i]](stext)) {
-					mc++;
-					if(auto_delimiter) aprintf(stext, "%s", delimiter);
+	for(i=0; i<LENGTH(message_funcs_order); i++)
+		if(segments[f = message_funcs_order[i]]==NULL) {
+			segments[f] = status_new(max_status_length);
+			sched_push(f, now);
+			event_driven[f] = 1;
+		}
+#endif
+#ifndef NO_VIEWS
+	// sensors only a view shows are read as well
+	for(v=0; v<LENGTH(views); v++)
+		for(f=0; f<NUMFUNCS; f++)
+			if(views[v].templates[f].src!=NULL && segments[f]==NULL) {
+				segments[f] = status_new(max_status_length);
+				sched_push(f, now);
+			}
+#endif
+#ifdef USE_THREADS
+	if((collect_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+		die("statinator4k: cannot create collector event\n");
+	reactor_watch(collect_fd, EvCollect, EPOLLIN);
+	for(f=0; f<NUMFUNCS; f++)
+		if(sensor_threads[f] && segments[f]!=NULL)
+			collector_start(f);
+#endif
+	ostext[0] = 0;
+
+	while ( running ) {
+		now = now_ms(CLOCK_MONOTONIC);
+		if(!harvest && (!sched_len || sched_heap[0].due > now)) {
+			its.it_value.tv_sec = sched_len ? sched_heap[0].due / 1000 : 0; // 0 disarms the timer
+			its.it_value.tv_nsec = sched_len ? (sched_heap[0].due % 1000) * 1000000 : 0;
+			timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+
+			if((n = epoll_wait(epoll_fd, events, LENGTH(events), -1)) < 0 && errno!=EINTR)
+				die("statinator4k: epoll_wait failed\n");
+
+			for(i=0; i<n; i++) {
+				switch(events[i].data.u64 >> 32) {
+				case EvTimer:
+					while(read(timer_fd, &expirations, sizeof(expirations)) > 0);
+					break;
+				case EvSignal:
+					while(read(signal_fd, &si, sizeof(si)) == sizeof(si)) {
+						if(si.ssi_signo==SIGHUP) { // refresh and format everything
+							for(f=0; f<NUMFUNCS; f++) {
+								if(segments[f]!=NULL)
+									segments[f]->valid = 0;
+#ifdef USE_THREADS
+								if(collectors[f]!=NULL)
+									__atomic_store_n(&collectors[f]->refresh, 1, __ATOMIC_RELEASE);
+#endif
+								sched_now(f);
+							}
+						}
+						else
+							running = 0;
+					}
+					break;
+#ifdef USE_NOTIFY
+				case EvNotify:
+					while(notify_check());
+					sched_now(NOTIFY);
+					break;
+#endif
+				case EvUevent:
+					read_uevent((int)(events[i].data.u64 & 0xffffffff));
+					break;
+				case EvRtnl:
+					read_rtnl((int)(events[i].data.u64 & 0xffffffff));
+					break;
+#ifdef USE_THREADS
+				case EvCollect:
+					while(read(collect_fd, &expirations, sizeof(expirations)) > 0);
+					harvest = 1;
+					break;
+#endif
+#ifdef USE_SOCKETS
+				case EvMp: // player connected, answered or went away
+					f = events[i].data.u64 & 0xffffffff;
+					epoll_ctl(epoll_fd, EPOLL_CTL_DEL, f, NULL);
+					__atomic_store_n(&mp_stat.con.event, f + 1, __ATOMIC_RELEASE);
+					sched_now(MP);
+					break;
+#endif
 				}
+			}
+			continue;
+		}
+
+#ifdef USE_URING
+		for(i=0; i<NUMFUNCS; i++)
+			due[i] = 0;
+		for(i=0; i<sched_len; i++)
+			due[sched_heap[i].func] |= sched_heap[i].due <= now;
+#ifdef USE_THREADS
+		for(i=0; i<NUMFUNCS; i++) // their threads read on their own
+			due[i] &= collectors[i]==NULL;
+#endif
+		uring_prefetch(due);
+#endif
+
+		// only the sensors that are due get read, all others keep their last output,
+		// and only a segment that was formatted again or came or went needs a new status
+		dirty = 0;
+#ifdef USE_THREADS
+		// readings of the collector threads first, they are idle until kicked again below
+		for(f=0; harvest && f<NUMFUNCS; f++)
+			if(collectors[f]!=NULL && collector_harvest(collectors[f]))
+				dirty |= segment_done(f, collectors[f]->ok);
+		harvest = 0;
+		// a thread that is over its budget shows its last reading marked as stale
+		for(f=0; f<NUMFUNCS; f++) {
+			if(collectors[f]==NULL)
+				continue;
+			ok = collectors[f]->busy && now - collectors[f]->kicked > (sensor_budgets[f] > 0 ? sensor_budgets[f] : sensor_budget);
+			dirty |= ok!=segment_stale[f] && segment_ok[f];
+			segment_stale[f] = ok;
+		}
+#endif
+		while(sched_len && sched_heap[0].due <= now) {
+			d = sched_pop();
+#ifdef USE_THREADS
+			if(collectors[d.func]!=NULL) {
+				collector_kick(collectors[d.func], now);
+				sched_push(d.func, sched_next(d.func, now));
+				continue;
+			}
+#endif
+#ifdef USE_THREADS
+			started = now_ms(CLOCK_MONOTONIC);
+#endif
+			ok = statusfuncs[d.func](segments[d.func]);
+			dirty |= segment_done(d.func, ok);
+#ifdef USE_THREADS
+			budget_check(d.func, now_ms(CLOCK_MONOTONIC) - started);
+#endif
+			if(ok || !event_driven[d.func])
+				sched_push(d.func, sched_next(d.func, now));
+		}
+#ifdef USE_URING
+		// a getter that gave up early did not consume all of its prefetched sources,
+		// next tick they would serve this tick's data
+		for(i=0; i<num_sources; i++)
+			if(sources[i]->prefetched)
+				sources[i]->prefetched = 0;
+#endif
+#ifndef NO_VIEWS
+		for(v=0; v<LENGTH(views); v++)
+			if(views[v].dirty)
+				view_write(&views[v]);
+#endif
+		if(!dirty)
+			continue;
+
+		status_reset(&stext);
+		aputs(&stext, " ");
+		mc = 0;
+
+#ifndef NO_MSG_FUNCS
+		for(i=0; i<LENGTH(message_funcs_order); i++)
+			if(segment_ok[message_funcs_order[i]]) {
+				aputs(&stext, segments[message_funcs_order[i]]->buf);
+				mc++;
+				if(auto_delimiter) aputs(&stext, delimiter);
+			}
 #endif
 
-			if(mc<=max_big_messages)
-				for(i=0; i<LENGTH(status_funcs_order); i++) {
-					if(statusfuncs[status_funcs_order[i]](stext) && i<LENGTH(status_funcs_order)-1)
-						if(auto_delimiter) aprintf(stext, "%s", delimiter);
+		if(mc<=max_big_messages)
+			for(i=0; i<LENGTH(status_funcs_order); i++) {
+				if(segment_ok[status_funcs_order[i]]) {
+#ifdef USE_THREADS
+					if(segment_stale[status_funcs_order[i]])
+						aputs(&stext, stale_mark);
+#endif
+					aputs(&stext, segments[status_funcs_order[i]]->buf);
+					if(auto_delimiter && i<LENGTH(status_funcs_order)-1) aputs(&stext, delimiter);
 				}
+			}
 
-           if(strcmp(stext, ostext)!=0) {
+		if(strcmp(stext.buf, ostext)!=0) {
 #ifdef USE_X11
-				XChangeProperty(dpy, root, XA_WM_NAME, XA_STRING, 8, PropModeReplace, (unsigned char*)stext, strlen(stext));
-				XFlush(dpy);
-				printf("%s\n", stext);
+			XChangeProperty(dpy, root, XA_WM_NAME, XA_STRING, 8, PropModeReplace, (unsigned char*)stext.buf, stext.len);
+			XFlush(dpy);
+			printf("%s\n", stext.buf);
 #else
-				printf("%s\n", stext);
+			printf("%s\n", stext.buf);
 #endif
-            }
-                        strcpy(ostext, stext);
-			sleep(refresh_wait);
+			memcpy(ostext, stext.buf, stext.len + 1);
 		}
+	}
 
+#ifdef USE_X11
+	XCloseDisplay(dpy);
+#endif
 	return 0;
 }
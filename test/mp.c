@@ -0,0 +1,223 @@
+/*
+ * get_mp against a scripted fake player on 127.0.0.1: refused connects back off up to
+ * con_backoff_max, a reply cut in the middle of a line is a failure and the next
+ * connect recovers, madasul hanging up after a reply is none. An mpd parked in idle is
+ * only asked again after it reported a change. A player that accepts late or never
+ * answers is given up after con_timeout.
+ * Build and run with: make check
+ */
+#define main s4k_main
+#include "../s4k.c"
+#undef main
+
+#include <sys/wait.h>
+
+#define PORT 16601
+
+#define CHECK(c) do { if(!(c)) { fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, #c); failures++; } } while(0)
+#define RUN_UNTIL(c, ms) for(until = now_ms(CLOCK_MONOTONIC) + (ms); !(c) && now_ms(CLOCK_MONOTONIC) < until; usleep(2000)) get_mp(st)
+
+typedef struct { // what the fake player does on one connection
+	const char *greeting;
+	const char *reply[4];   // sent in parts, with a pause in between
+	char hangup;            // after the reply, otherwise it answers idle below
+	int delay;              // ms before the connection is accepted
+	char silent;            // accepts and never reads or writes anything
+} t_script;
+
+static int failures = 0;
+static long long until;
+static t_status *st;
+static int traffic[2]; // commands the fake player read, written by it and counted by the test
+
+static int listener() {
+	struct sockaddr_in sa;
+	int fd = socket(AF_INET, SOCK_STREAM, 0), one = 1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(PORT);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if(bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(fd, 4) < 0)
+		die("test: cannot listen on %d\n", PORT);
+	return fd;
+}
+
+// Plays the scripts, one per connection, in a child. Every command it reads goes into
+// traffic, so the test can count them.
+static pid_t serve(const t_script *script, int num) {
+	static const char song[] = "state: play\nelapsed: 1.500\nduration: 200.000\nOK\nTitle: Song 2\nOK\n";
+	char buf[BUF_SIZE];
+	int fd = listener(), c, i, j, changed;
+	ssize_t n;
+	pid_t pid;
+
+	if((pid = fork()) != 0) {
+		close(fd);
+		return pid;
+	}
+	for(i=0; i<num && (usleep(script[i].delay * 1000), c = accept(fd, NULL, NULL)) >= 0; i++) {
+		if(script[i].silent) {
+			pause(); // until stop()
+			continue;
+		}
+		if(script[i].greeting)
+			write(c, script[i].greeting, strlen(script[i].greeting));
+		if((n = read(c, buf, sizeof(buf))) > 0)
+			write(traffic[1], buf, n);
+		for(j=0; j<LENGTH(script[i].reply) && script[i].reply[j]; j++) {
+			if(j)
+				usleep(50000);
+			write(c, script[i].reply[j], strlen(script[i].reply[j]));
+		}
+		// mpd: the first idle is answered with a change of the song, the next one never
+		for(changed = 0; !script[i].hangup && (n = read(c, buf, sizeof(buf) - 1)) > 0; ) {
+			write(traffic[1], buf, n);
+			buf[n] = '\0';
+			if(strstr(buf, "currentsong"))
+				write(c, song, strlen(song));
+			if(strstr(buf, "idle") && !changed++) {
+				usleep(200000);
+				write(c, "changed: player\nOK\n", 19);
+			}
+		}
+		close(c);
+	}
+	_exit(0);
+}
+
+static int commands() {
+	char buf[BUF_SIZE * 4];
+	int i, num = 0;
+	ssize_t n;
+
+	while((n = read(traffic[0], buf, sizeof(buf))) > 0)
+		for(i=0; i<n; i++)
+			num += buf[i]=='\n';
+	return num;
+}
+
+static void stop(pid_t pid) {
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+}
+
+static void test_madasul() {
+	static const t_script script[] = {
+		{ NULL, { "3\t9\t3\t0\t5\tCut Art" }, 1 },                                 // eof mid-line
+		{ NULL, { "3\t9\t3\t0\t5\tSplit Ar", "tist\tAlbum\tTitle\n" }, 1 },        // partial reply
+		{ NULL, { "3\t9\t3\t0\t5\tSome Artist\tAlbum\tTitle\n" }, 1 },
+	};
+	long long retry;
+	int attempts = 0;
+	pid_t pid;
+
+	mp_parse = mp_parse_madasul;
+	con_init(&mp_stat.con, "127.0.0.1", PORT, EvMp);
+
+	// nobody listening: every connect is refused, the waits double up to the maximum
+	for(until = now_ms(CLOCK_MONOTONIC) + 1000, retry = 0; now_ms(CLOCK_MONOTONIC) < until; usleep(2000)) {
+		CHECK(get_mp(st)==0);
+		attempts += mp_stat.con.retry != retry;
+		retry = mp_stat.con.retry;
+	}
+	CHECK(mp_stat.con.failed);
+	CHECK(mp_stat.con.backoff==con_backoff_max);
+	CHECK(attempts>=4 && attempts<=10); // 50, 100, 200, 200.. plus jitter, not every 2ms
+
+	pid = serve(script, LENGTH(script));
+	RUN_UNTIL(mp_stat.valid, 2000);
+	CHECK(mp_stat.valid);
+	CHECK(strcmp(mp_stat.artist, "Split Artist")==0); // the cut line was never taken
+	CHECK(!mp_stat.con.failed && mp_stat.con.backoff==con_backoff_min);
+
+	// it hangs up after every reply, the next tick just connects again
+	RUN_UNTIL(strcmp(mp_stat.artist, "Some Artist")==0, 1000);
+	CHECK(strcmp(mp_stat.artist, "Some Artist")==0);
+	CHECK(!mp_stat.con.failed && mp_stat.con.backoff==con_backoff_min);
+	CHECK(commands()==3);
+	stop(pid);
+	con_close(&mp_stat.con);
+}
+
+// the kernel completes the connect before accept(), the query goes out and nothing
+// comes back: a listener that accepts late and a player that never says a word
+static void test_timeout() {
+	static const t_script slow[] = { { NULL, { NULL }, 1, 1000 } };
+	static const t_script silent[] = { { NULL, { NULL }, 0, 0, 1 } };
+	long long started;
+	pid_t pid;
+
+	mp_parse = mp_parse_madasul;
+	con_init(&mp_stat.con, "127.0.0.1", PORT, EvMp);
+	pid = serve(slow, LENGTH(slow));
+	started = now_ms(CLOCK_MONOTONIC);
+	RUN_UNTIL(mp_stat.con.failed, 2000);
+	CHECK(mp_stat.con.failed && !mp_stat.valid);
+	started = now_ms(CLOCK_MONOTONIC) - started;
+	CHECK(started >= con_timeout && started < 1000); // given up before the accept
+	CHECK(mp_stat.con.backoff==con_backoff_min * 2);
+	stop(pid);
+	con_close(&mp_stat.con);
+
+	mp_parse = mp_parse_mpd;
+	con_init(&mp_stat.con, "127.0.0.1", PORT, EvMp);
+	mp_stat.known = mp_stat.idle = 0;
+	pid = serve(silent, LENGTH(silent));
+	started = now_ms(CLOCK_MONOTONIC);
+	RUN_UNTIL(mp_stat.con.failed, 2000);
+	CHECK(mp_stat.con.failed && !mp_stat.valid);
+	CHECK(now_ms(CLOCK_MONOTONIC) - started >= con_timeout);
+	CHECK(mp_stat.con.backoff==con_backoff_min * 2);
+	stop(pid);
+	con_close(&mp_stat.con);
+	commands(); // whatever the late listener read
+}
+
+static void test_mpd() {
+	static const t_script script[] = {
+		{ "OK MPD 0.23.5\n", { "state: play\nelapsed: 10.000\nduration: 200.000\nOK\n", "Artist: Band\nArtistSort: Band, The\nAlbum: Record\nAlbumArtist: Various\nTitle: Song 1\nOK\n" }, 0 },
+	};
+	pid_t pid;
+
+	mp_parse = mp_parse_mpd;
+	con_init(&mp_stat.con, "127.0.0.1", PORT, EvMp);
+	mp_stat.valid = mp_stat.known = mp_stat.idle = 0;
+	pid = serve(script, LENGTH(script));
+
+	RUN_UNTIL(mp_stat.idle, 1000);
+	RUN_UNTIL(0, 50);
+	CHECK(strcmp(mp_stat.title, "Song 1")==0 && mp_stat.position==10);
+	CHECK(strcmp(mp_stat.artist, "Band")==0 && strcmp(mp_stat.album, "Record")==0); // not the Sort or AlbumArtist tags
+	CHECK(mp_stat.duration==200);
+	CHECK(commands()==3); // status, currentsong, idle
+
+	// parked in idle until the player changes, then the song comes in right away
+	RUN_UNTIL(strcmp(mp_stat.title, "Song 2")==0 && mp_stat.idle, 1000);
+	RUN_UNTIL(0, 50);
+	CHECK(strcmp(mp_stat.title, "Song 2")==0);
+	CHECK(commands()==3); // status, currentsong, idle
+	RUN_UNTIL(0, 300);
+	CHECK(commands()==0); // nothing while idle, the position moves on its own
+	CHECK(mp_stat.position==1);
+	stop(pid);
+	con_close(&mp_stat.con);
+}
+
+int main() {
+	if(pipe(traffic) < 0 || fcntl(traffic[0], F_SETFL, O_NONBLOCK) < 0 || (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		die("test: setup failed\n");
+	signal(SIGPIPE, SIG_IGN);
+	st = status_new(max_status_length);
+	con_backoff_min = 50;
+	con_backoff_max = 200;
+	con_timeout = 300;
+
+	test_madasul();
+	test_timeout();
+	test_mpd();
+
+	printf("mp: %s\n", failures ? "FAILED" : "ok");
+	return failures!=0;
+}